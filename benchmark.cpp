@@ -16,15 +16,18 @@ int main(int argc, char* argv[])
 struct SmallStaticStruct {};
 struct SmallStaticStructWithContext {};
 struct SmallStruct {};
+struct SmallBoundedNestedStruct {};
+struct SmallBoundedStruct {};
 
 namespace jsonwriter {
 
 template<>
 struct Formatter<SmallStaticStruct> {
+    template<typename BufferType>
 #ifndef _MSC_VER
     __attribute__((always_inline)) inline
 #endif
-    static void write(jsonwriter::Buffer& output, const SmallStaticStruct)
+    static void write(BufferType& output, const SmallStaticStruct)
     {
         jsonwriter::write(output, jsonwriter::Object{[](auto& object) {
             object["k1"] = "cd";
@@ -40,9 +43,46 @@ struct Formatter<SmallStaticStruct> {
     }
 };
 
+// SmallStaticStruct with a fixed size list, the maximum size is known at compile time
+template<>
+struct Formatter<SmallBoundedNestedStruct> {
+    static constexpr size_t MAX_SIZE{
+        max_object_size<std::array<int, 3>, bool, char[4], char>({{"o1", "o2", "o\r3", "o4"}})};
+
+    template<typename BufferType>
+    static void write(BufferType& output, const SmallBoundedNestedStruct)
+    {
+        jsonwriter::write(output, jsonwriter::Object{[](auto& nested_object) {
+            nested_object["o1"] = std::array<int, 3>{{1, 2, 999999999}};
+            nested_object["o2"] = false;
+            nested_object["o\r3"] = "i\no";
+            nested_object["o4"] = 'c';
+        }});
+    }
+};
+
+template<>
+struct Formatter<SmallBoundedStruct> {
+    static constexpr size_t MAX_SIZE{
+        max_object_size<char[3], SmallBoundedNestedStruct, bool, double>(
+            {{"k1", "k2", "k3", "k4"}})};
+
+    template<typename BufferType>
+    static void write(BufferType& output, const SmallBoundedStruct)
+    {
+        jsonwriter::write(output, jsonwriter::Object{[](auto& object) {
+            object["k1"] = "cd";
+            object["k2"] = SmallBoundedNestedStruct{};
+            object["k3"] = false;
+            object["k4"] = 234.345678;
+        }});
+    }
+};
+
 template<>
 struct Formatter<SmallStruct> {
-    static void write(jsonwriter::Buffer& output, const SmallStruct)
+    template<typename BufferType>
+    static void write(BufferType& output, const SmallStruct)
     {
         jsonwriter::write(output, jsonwriter::Object{[](auto& object) {
             object[random_strings[0]] = random_strings[1];
@@ -60,10 +100,11 @@ struct Formatter<SmallStruct> {
 
 template<>
 struct Formatter<SmallStaticStructWithContext> {
+    template<typename BufferType>
 #ifndef _MSC_VER
     __attribute__((always_inline)) inline
 #endif
-    static void write(jsonwriter::Buffer& output, const SmallStaticStructWithContext)
+    static void write(BufferType& output, const SmallStaticStructWithContext)
     {
         jsonwriter::write(output, jsonwriter::Object{[&output](auto& object) {
             object["k1"] = "cd";
@@ -97,6 +138,66 @@ void BM_jsonwriter_simple_small_static_struct(benchmark::State& state)
 }
 BENCHMARK(BM_jsonwriter_simple_small_static_struct);
 
+void BM_jsonwriter_simple_small_static_struct_type_erased(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer buffer{};
+    // hide the dynamic type like a Buffer& coming from another translation unit
+    jsonwriter::Buffer* out_ptr{&buffer};
+    benchmark::DoNotOptimize(out_ptr);
+    jsonwriter::Buffer& out{*out_ptr};
+
+    for (auto _ : state) {
+        jsonwriter::write(out, SmallStaticStruct{});
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+        out.clear();
+    }
+}
+BENCHMARK(BM_jsonwriter_simple_small_static_struct_type_erased);
+
+void BM_jsonwriter_simple_small_static_struct_cursor(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer out{};
+
+    for (auto _ : state) {
+        {
+            // more than the largest output
+            auto cursor = out.reserve_cursor(256);
+            jsonwriter::write(cursor, SmallStaticStruct{});
+        }
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+        out.clear();
+    }
+}
+BENCHMARK(BM_jsonwriter_simple_small_static_struct_cursor);
+
+void BM_jsonwriter_simple_small_static_struct_fixed(benchmark::State& state)
+{
+    jsonwriter::FixedBuffer<1024> out{};
+
+    for (auto _ : state) {
+        jsonwriter::write(out, SmallStaticStruct{});
+        benchmark::DoNotOptimize(out.overflowed());
+        benchmark::ClobberMemory();
+        out.clear();
+    }
+}
+BENCHMARK(BM_jsonwriter_simple_small_static_struct_fixed);
+
+void BM_jsonwriter_simple_small_bounded_struct(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer out{};
+
+    for (auto _ : state) {
+        jsonwriter::write(out, SmallBoundedStruct{});
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+        out.clear();
+    }
+}
+BENCHMARK(BM_jsonwriter_simple_small_bounded_struct);
+
 void BM_jsonwriter_simple_small_static_struct_list(benchmark::State& state)
 {
     jsonwriter::SimpleBuffer out{};
@@ -212,6 +313,24 @@ void BM_jsonwriter_large_list_of_doubles(benchmark::State& state)
 }
 BENCHMARK(BM_jsonwriter_large_list_of_doubles);
 
+void BM_jsonwriter_large_list_of_float16(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer out{};
+    std::vector<jsonwriter::Float16> values{};
+    for (const auto bits : large_float16_list) {
+        values.push_back(jsonwriter::Float16{bits});
+    }
+    out.reserve(values.size() * 11);
+
+    for (auto _ : state) {
+        jsonwriter::write(out, values);
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+        out.clear();
+    }
+}
+BENCHMARK(BM_jsonwriter_large_list_of_float16);
+
 void BM_jsonwriter_large_list_of_bools(benchmark::State& state)
 {
     jsonwriter::SimpleBuffer out{};
@@ -0,0 +1,588 @@
+#include <benchmark/benchmark.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "jsonwriter/chain.hpp"
+#include "jsonwriter/fd.hpp"
+#include "jsonwriter/mmap.hpp"
+#include "jsonwriter/thread.hpp"
+#endif
+#ifdef __linux__
+#include "jsonwriter/uring.hpp"
+#endif
+#if __has_include(<zlib.h>)
+#include "jsonwriter/deflate.hpp"
+#endif
+#include "jsonwriter/pmr.hpp"
+#include "jsonwriter/pool.hpp"
+#include "jsonwriter/writer.hpp"
+#include "benchmark_common.hpp"
+
+namespace {
+
+// a few kB response, more than the static part of SimpleBuffer
+template<typename BufferType>
+void write_response(BufferType& out)
+{
+    jsonwriter::write(out, jsonwriter::Object{[](auto& object) {
+        object["names"] = jsonwriter::Span<std::string>{random_strings.data(), 10};
+        object["values"] = jsonwriter::Span<int>{large_int_list.data(), 1000};
+    }});
+}
+
+void BM_buffer_per_request_simple(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        write_response(out);
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_buffer_per_request_simple)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_buffer_per_request_pool(benchmark::State& state)
+{
+    static jsonwriter::BufferPool pool{};
+
+    const auto allocations = pool.allocations();
+    for (auto _ : state) {
+        auto out = pool.acquire();
+        write_response(out);
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+    }
+    // heap allocations per request of all threads, zero in the steady state
+    state.counters["allocs"] = benchmark::Counter(
+        static_cast<double>(pool.allocations() - allocations),
+        benchmark::Counter::Flags(benchmark::Counter::kAvgIterations
+                                  | benchmark::Counter::kAvgThreads));
+}
+BENCHMARK(BM_buffer_per_request_pool)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_buffer_per_request_pmr(benchmark::State& state)
+{
+    // per-request arena
+    std::vector<char> arena(256 * 1024);
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource resource{arena.data(), arena.size()};
+        jsonwriter::PmrBuffer out{&resource};
+        write_response(out);
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_buffer_per_request_pmr);
+
+// the response returned as std::string
+void BM_buffer_to_string_copy(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        write_response(out);
+        std::string result{out.begin(), out.end()};
+        benchmark::DoNotOptimize(result.data());
+    }
+}
+BENCHMARK(BM_buffer_to_string_copy);
+
+void BM_buffer_to_string_direct(benchmark::State& state)
+{
+    for (auto _ : state) {
+        std::string result{};
+        jsonwriter::StringBuffer out{result};
+        write_response(out);
+        out.finish();
+        benchmark::DoNotOptimize(result.data());
+    }
+}
+BENCHMARK(BM_buffer_to_string_direct);
+
+// the size of the response only
+void BM_buffer_size_write(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        write_response(out);
+        benchmark::DoNotOptimize(out.size());
+    }
+}
+BENCHMARK(BM_buffer_size_write);
+
+void BM_buffer_size_count(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::CountingBuffer out{};
+        write_response(out);
+        benchmark::DoNotOptimize(out.count());
+    }
+}
+BENCHMARK(BM_buffer_size_count);
+
+void BM_buffer_to_string_exact(benchmark::State& state)
+{
+    // Object references the callback
+    const auto write_members = [](auto& object) {
+        object["names"] = jsonwriter::Span<std::string>{random_strings.data(), 10};
+        object["values"] = jsonwriter::Span<int>{large_int_list.data(), 1000};
+    };
+    const auto response = jsonwriter::Object{write_members};
+    for (auto _ : state) {
+        std::string result{};
+        jsonwriter::write_exact(response, [&result](const size_t size) {
+            result.resize(size);
+            return result.data();
+        });
+        benchmark::DoNotOptimize(result.data());
+    }
+}
+BENCHMARK(BM_buffer_to_string_exact);
+
+// the response framed by an HTTP header which depends on the body size
+void BM_buffer_framing_copy(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer framed{};
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer body{};
+        write_response(body);
+        const auto header = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size())
+                            + "\r\n\r\n";
+        framed.clear();
+        framed.make_room(header.size() + body.size());
+        framed.consume(std::copy_n(header.data(), header.size(), framed.working_end()));
+        framed.consume(std::copy_n(body.data(), body.size(), framed.working_end()));
+        benchmark::DoNotOptimize(framed.data());
+    }
+}
+BENCHMARK(BM_buffer_framing_copy);
+
+void BM_buffer_framing_headroom(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        out.reserve_headroom(64);
+        write_response(out);
+        out.prepend("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(out.size())
+                    + "\r\n\r\n");
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+BENCHMARK(BM_buffer_framing_headroom);
+
+// items of a list written speculatively, every other one dropped by a filter
+void BM_buffer_speculative_copy(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        out.append('[');
+        bool first{true};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::SimpleBuffer item{};
+            bool rejected{false};
+            jsonwriter::write(item, jsonwriter::Object{[&](auto& object) {
+                object["id"] = i;
+                object["name"] = random_strings[static_cast<size_t>(i) % random_strings.size()];
+                rejected = i % 2 == 1;
+            }});
+            if (!rejected) {
+                if (!first) {
+                    out.append(',');
+                }
+                first = false;
+                out.make_room(item.size());
+                out.consume(std::copy_n(item.data(), item.size(), out.working_end()));
+            }
+        }
+        out.append(']');
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+BENCHMARK(BM_buffer_speculative_copy);
+
+void BM_buffer_speculative_checkpoint(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, jsonwriter::List{[&out](auto& list) {
+            for (int i{0}; i < 100; ++i) {
+                const auto mark = out.checkpoint();
+                bool rejected{false};
+                list.push_back(jsonwriter::Object{[&](auto& object) {
+                    object["id"] = i;
+                    object["name"] = random_strings[static_cast<size_t>(i) % random_strings.size()];
+                    rejected = i % 2 == 1;
+                }});
+                if (rejected) {
+                    out.rollback(mark);
+                }
+            }
+        }});
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+BENCHMARK(BM_buffer_speculative_checkpoint);
+
+// small buffers passed through a queue
+void BM_buffer_move_through_queue(benchmark::State& state)
+{
+    std::vector<jsonwriter::SimpleBuffer<>> ring(16);
+    size_t position{0};
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, 1234567);
+        auto& slot = ring[position++ % ring.size()];
+        slot = std::move(out);
+        jsonwriter::SimpleBuffer received{std::move(slot)};
+        benchmark::DoNotOptimize(received.data());
+    }
+}
+BENCHMARK(BM_buffer_move_through_queue);
+
+/// Counts the copying growths.
+template<typename GrowthPolicy>
+class CountingSimpleBuffer : public jsonwriter::SimpleBuffer<1024, GrowthPolicy>
+{
+public:
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        const auto old_capacity = this->capacity();
+        jsonwriter::SimpleBuffer<1024, GrowthPolicy>::realloc(data_size, new_capacity);
+        if (this->capacity() != old_capacity) {
+            ++reallocs;
+            bytes_copied += data_size;
+        }
+    }
+
+    size_t reallocs{0};
+    size_t bytes_copied{0};
+};
+
+// documents from 4 kB to 64 MB
+template<typename GrowthPolicy>
+void BM_buffer_growth_policy(benchmark::State& state)
+{
+    const auto document_size = static_cast<size_t>(state.range(0));
+    const jsonwriter::Span<int> chunk{large_int_list.data(), 100};
+    size_t reallocs{0};
+    size_t bytes_copied{0};
+    size_t capacity{0};
+    for (auto _ : state) {
+        CountingSimpleBuffer<GrowthPolicy> out{};
+        while (out.size() < document_size) {
+            jsonwriter::write(out, chunk);
+        }
+        benchmark::DoNotOptimize(out.begin());
+        reallocs = out.reallocs;
+        bytes_copied = out.bytes_copied;
+        capacity = out.capacity();
+    }
+    state.counters["reallocs"] = static_cast<double>(reallocs);
+    state.counters["copied"] = static_cast<double>(bytes_copied);
+    state.counters["capacity"] = static_cast<double>(capacity);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * document_size));
+}
+BENCHMARK_TEMPLATE(BM_buffer_growth_policy, jsonwriter::GrowthFactor<>)
+    ->RangeMultiplier(16)
+    ->Range(4 << 10, 64 << 20);
+BENCHMARK_TEMPLATE(BM_buffer_growth_policy, jsonwriter::GrowthFactor<2, 1>)
+    ->RangeMultiplier(16)
+    ->Range(4 << 10, 64 << 20);
+BENCHMARK_TEMPLATE(BM_buffer_growth_policy, jsonwriter::GrowthSizeClasses<>)
+    ->RangeMultiplier(16)
+    ->Range(4 << 10, 64 << 20);
+BENCHMARK_TEMPLATE(BM_buffer_growth_policy, jsonwriter::GrowthHugePages<>)
+    ->RangeMultiplier(16)
+    ->Range(4 << 10, 64 << 20);
+
+// a long-lived connection buffer, a large response after every 100 small ones
+template<typename ShrinkPolicy>
+void BM_buffer_shrink_policy(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer<1024, jsonwriter::GrowthFactor<>, ShrinkPolicy> out{};
+    size_t documents{0};
+    size_t grows{0};
+    size_t capacity_sum{0};
+    for (auto _ : state) {
+        const auto capacity = out.capacity();
+        if (documents % 101 == 100) {
+            jsonwriter::write(out, large_int_list);
+        } else {
+            write_response(out);
+        }
+        benchmark::DoNotOptimize(out.data());
+        grows += out.capacity() > capacity ? 1 : 0;
+        out.clear();
+        capacity_sum += out.capacity();
+        ++documents;
+    }
+    state.counters["grows"] = benchmark::Counter(static_cast<double>(grows),
+                                                 benchmark::Counter::kAvgIterations);
+    state.counters["capacity"] = benchmark::Counter(static_cast<double>(capacity_sum),
+                                                    benchmark::Counter::kAvgIterations);
+}
+BENCHMARK_TEMPLATE(BM_buffer_shrink_policy, jsonwriter::NoShrink);
+BENCHMARK_TEMPLATE(BM_buffer_shrink_policy, jsonwriter::ShrinkAfter<4>);
+BENCHMARK_TEMPLATE(BM_buffer_shrink_policy, jsonwriter::ShrinkAfter<16>);
+BENCHMARK_TEMPLATE(BM_buffer_shrink_policy, jsonwriter::ShrinkAfter<256>);
+
+#if __has_include(<zlib.h>)
+
+// a large document compressed for sending, uncompressed MB/s
+void BM_buffer_gzip_whole(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer compressed{};
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::write(out, large_int_list);
+        }
+        z_stream stream{};
+        deflateInit2(&stream, 1, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        compressed.clear();
+        compressed.make_room(deflateBound(&stream, out.size()));
+        stream.next_in = reinterpret_cast<Bytef*>(out.data());
+        stream.avail_in = static_cast<uInt>(out.size());
+        stream.next_out = reinterpret_cast<Bytef*>(compressed.working_end());
+        stream.avail_out = static_cast<uInt>(compressed.room());
+        deflate(&stream, Z_FINISH);
+        compressed.consume(reinterpret_cast<char*>(stream.next_out));
+        deflateEnd(&stream);
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(out.size()));
+    }
+}
+BENCHMARK(BM_buffer_gzip_whole);
+
+// chunk size
+void BM_buffer_gzip_streamed(benchmark::State& state)
+{
+    jsonwriter::SimpleBuffer compressed{};
+    for (auto _ : state) {
+        compressed.clear();
+        jsonwriter::DeflateBuffer out{compressed, jsonwriter::DeflateFormat::gzip, 1,
+                                      static_cast<size_t>(state.range(0))};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::write(out, large_int_list);
+        }
+        out.finish();
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(out.flushed()));
+    }
+}
+BENCHMARK(BM_buffer_gzip_streamed)->RangeMultiplier(4)->Range(16 << 10, 1 << 20);
+
+#endif
+
+#ifndef _WIN32
+
+// a large document, the whole of it in memory vs. streamed in 64 kB chunks
+void BM_buffer_large_document_simple(benchmark::State& state)
+{
+    const int fd{::open("/dev/null", O_WRONLY)};
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::write(out, large_int_list);
+        }
+        benchmark::DoNotOptimize(::write(fd, out.data(), out.size()));
+    }
+    ::close(fd);
+}
+BENCHMARK(BM_buffer_large_document_simple);
+
+void BM_buffer_large_document_fd(benchmark::State& state)
+{
+    const int fd{::open("/dev/null", O_WRONLY)};
+    for (auto _ : state) {
+        jsonwriter::FdBuffer out{fd, 64 * 1024};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::write(out, large_int_list);
+        }
+        out.flush();
+    }
+    ::close(fd);
+}
+BENCHMARK(BM_buffer_large_document_fd);
+
+// a large document built in memory, growing from a small buffer
+template<typename BufferType>
+void write_large_document(benchmark::State& state, BufferType& out)
+{
+    for (int i{0}; i < 100; ++i) {
+        jsonwriter::write(out, large_int_list);
+    }
+    benchmark::DoNotOptimize(out.begin());
+    benchmark::ClobberMemory();
+    state.counters["bytes"] = static_cast<double>(out.size());
+}
+
+void BM_buffer_growth_simple(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        write_large_document(state, out);
+    }
+}
+BENCHMARK(BM_buffer_growth_simple);
+
+void BM_buffer_growth_mmap(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::MmapBuffer out{};
+        write_large_document(state, out);
+    }
+}
+BENCHMARK(BM_buffer_growth_mmap);
+
+void BM_buffer_growth_mmap_huge_pages(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::MmapBuffer out{0, true};
+        write_large_document(state, out);
+    }
+}
+BENCHMARK(BM_buffer_growth_mmap_huge_pages);
+
+void BM_buffer_growth_chain(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::ChainBuffer out{};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::write(out, large_int_list);
+        }
+        benchmark::DoNotOptimize(out.begin());
+        benchmark::ClobberMemory();
+        state.counters["bytes"] = static_cast<double>(out.total_size());
+    }
+}
+BENCHMARK(BM_buffer_growth_chain);
+
+// a response embedding a large pre-serialized blob, sent to /dev/null
+const auto large_blob = std::make_shared<std::string>(std::string(1 << 20, '1'));
+
+template<typename BufferType>
+void write_blob_response(BufferType& out)
+{
+    jsonwriter::write(out, jsonwriter::Object{[](auto& object) {
+        object["id"] = 42;
+        object["blob"] = jsonwriter::ExternalJson{*large_blob, large_blob};
+    }});
+}
+
+void BM_buffer_blob_copy(benchmark::State& state)
+{
+    const int fd{::open("/dev/null", O_WRONLY)};
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        write_blob_response(out);
+        benchmark::DoNotOptimize(::write(fd, out.data(), out.size()));
+    }
+    ::close(fd);
+}
+BENCHMARK(BM_buffer_blob_copy);
+
+void BM_buffer_blob_splice(benchmark::State& state)
+{
+    const int fd{::open("/dev/null", O_WRONLY)};
+    for (auto _ : state) {
+        jsonwriter::ChainBuffer out{};
+        write_blob_response(out);
+        out.write_to(fd);
+    }
+    ::close(fd);
+}
+BENCHMARK(BM_buffer_blob_splice);
+
+// a large document dumped to a file
+constexpr const char* DUMP_PATH{"/tmp/jsonwriter_benchmark_dump.json"};
+
+void BM_buffer_file_dump_simple(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::SimpleBuffer out{};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::write(out, large_int_list);
+        }
+        const int fd{::open(DUMP_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666)};
+        benchmark::DoNotOptimize(::write(fd, out.data(), out.size()));
+        ::close(fd);
+    }
+    ::unlink(DUMP_PATH);
+}
+BENCHMARK(BM_buffer_file_dump_simple);
+
+void BM_buffer_file_dump_mapped(benchmark::State& state)
+{
+    for (auto _ : state) {
+        jsonwriter::MappedFileBuffer out{DUMP_PATH};
+        for (int i{0}; i < 100; ++i) {
+            jsonwriter::write(out, large_int_list);
+        }
+        out.close();
+    }
+    ::unlink(DUMP_PATH);
+}
+BENCHMARK(BM_buffer_file_dump_mapped);
+
+// a large document streamed to a file in 256 kB chunks, synchronously vs. by io_uring
+void BM_buffer_file_stream_fd(benchmark::State& state)
+{
+    for (auto _ : state) {
+        const int fd{::open(DUMP_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666)};
+        {
+            jsonwriter::FdBuffer out{fd, 256 * 1024};
+            for (int i{0}; i < 100; ++i) {
+                jsonwriter::write(out, large_int_list);
+            }
+            out.flush();
+            state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(out.flushed()));
+        }
+        ::close(fd);
+    }
+    ::unlink(DUMP_PATH);
+}
+BENCHMARK(BM_buffer_file_stream_fd)->UseRealTime();
+
+void BM_buffer_file_stream_thread(benchmark::State& state)
+{
+    for (auto _ : state) {
+        const int fd{::open(DUMP_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666)};
+        {
+            jsonwriter::ThreadedFdBuffer out{fd, 256 * 1024, static_cast<size_t>(state.range(0))};
+            for (int i{0}; i < 100; ++i) {
+                jsonwriter::write(out, large_int_list);
+            }
+            out.flush();
+            state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(out.flushed()));
+        }
+        ::close(fd);
+    }
+    ::unlink(DUMP_PATH);
+}
+// number of chunks
+BENCHMARK(BM_buffer_file_stream_thread)->Arg(2)->Arg(4)->UseRealTime();
+
+#ifdef __linux__
+void BM_buffer_file_stream_uring(benchmark::State& state)
+{
+    for (auto _ : state) {
+        const int fd{::open(DUMP_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666)};
+        {
+            jsonwriter::UringFileBuffer out{fd, 256 * 1024, static_cast<size_t>(state.range(0))};
+            for (int i{0}; i < 100; ++i) {
+                jsonwriter::write(out, large_int_list);
+            }
+            out.flush();
+            state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(out.flushed()));
+        }
+        ::close(fd);
+    }
+    ::unlink(DUMP_PATH);
+}
+// number of chunks
+BENCHMARK(BM_buffer_file_stream_uring)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+#endif
+
+#endif
+
+} // namespace
@@ -2,6 +2,7 @@
 #ifndef BENCHMARK_COMMON_HPP__VWYMOSRJ
 #define BENCHMARK_COMMON_HPP__VWYMOSRJ
 
+#include <cstdint>
 #include <functional>
 #include <random>
 #include <string>
@@ -52,6 +53,18 @@ inline const auto large_double_list = std::invoke([]() {
     return v;
 });
 
+// raw IEEE binary16 bits, e.g. an embedding matrix row
+inline const auto large_float16_list = std::invoke([]() {
+    std::mt19937 engine{};
+    // normal numbers around [-4, 4]
+    std::uniform_int_distribution<uint16_t> gen_bits{0x0400, 0x4400};
+    std::vector<uint16_t> v{};
+    for (int i{0}; i < 10000; ++i) {
+        v.push_back(static_cast<uint16_t>(gen_bits(engine) | ((i & 1) << 15)));
+    }
+    return v;
+});
+
 inline const auto random_strings = std::invoke([]() {
     static const char alphanum[] = "0123456789"
                                    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
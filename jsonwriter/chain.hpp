@@ -0,0 +1,279 @@
+#pragma once
+#ifndef CHAIN_HPP__W8DJ3LSV
+#define CHAIN_HPP__W8DJ3LSV
+
+// POSIX only
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <jsonwriter/fd.hpp>
+#include <jsonwriter/writer.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+/// Growing buffer which never copies the data. When the room is exhausted the current segment is
+/// sealed and writing continues in a new one. External data can be spliced in between without
+/// copying. The output is a list of iovec for writev() or sendmsg(), linearize() joins it if
+/// needed. begin(), end() and size() cover the current segment only, see total_size().
+/// Not movable.
+class ChainBuffer : public BufferImpl<ChainBuffer>
+{
+public:
+    explicit ChainBuffer(const size_t segment_size = size_t{16} << 10)
+        : m_segment_capacity{std::max(segment_size, size_t{1})}
+    {
+        m_storage.push_back(Storage{m_segment_capacity});
+        set_data(m_storage[0].data.get(), 0, m_segment_capacity);
+    }
+
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+    ChainBuffer(ChainBuffer&&) = delete;
+    ChainBuffer& operator=(ChainBuffer&&) = delete;
+
+    /// Size of all segments.
+    size_t total_size() const noexcept { return m_sealed_size + size() - m_segment_start; }
+
+    /// The data in order. Valid until the next write or clear().
+    std::vector<iovec> iovecs() const
+    {
+        auto result = m_sealed;
+        if (size() > m_segment_start) {
+            result.push_back(
+                iovec{const_cast<char*>(data()) + m_segment_start, size() - m_segment_start});
+        }
+        return result;
+    }
+
+    /// Appends the external data without copying. The owner is kept until clear() or
+    /// linearize(), without an owner the data must outlive the use of iovecs().
+    void splice(const char* const external, const size_t external_size,
+                std::shared_ptr<const void> owner = {})
+    {
+        seal(size());
+        // the sealed data can't be prepended to, the headroom becomes part of the segment
+        set_data(m_storage[m_current].data.get(), headroom() + size(),
+                 m_storage[m_current].capacity, 0);
+        m_segment_start = size();
+        m_sealed.push_back(iovec{const_cast<char*>(external), external_size});
+        m_sealed_size += external_size;
+        if (owner != nullptr) {
+            m_owners.push_back(std::move(owner));
+        }
+    }
+
+    /// Writes all segments by writev(). Throws std::system_error.
+    void write_to(const int fd) const
+    {
+        auto vectors = iovecs();
+        detail::write_all(fd, vectors.data(), vectors.size());
+    }
+
+    /// Copies all segments to a single one, begin() and size() cover the whole data afterwards.
+    /// The following segments keep the configured size.
+    void linearize()
+    {
+        if (m_sealed.empty()) {
+            return;
+        }
+        const size_t total{total_size()};
+        Storage joined{std::max(total, m_segment_capacity)};
+        char* out{joined.data.get()};
+        for (const auto& vector : iovecs()) {
+            out = std::copy_n(static_cast<const char*>(vector.iov_base), vector.iov_len, out);
+        }
+        m_storage.clear();
+        m_storage.push_back(std::move(joined));
+        m_current = 0;
+        m_sealed.clear();
+        m_sealed_size = 0;
+        m_segment_start = 0;
+        m_owners.clear();
+        // may be smaller than an earlier joined segment
+        reset_data(m_storage[0].data.get(), total, m_storage[0].capacity, 0);
+    }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        // the formatters need contiguous room
+        m_segment_capacity = std::max(m_segment_capacity, new_capacity - data_size);
+        if (data_size > 0) {
+            seal(size());
+            m_segment_start = 0;
+            ++m_current;
+        }
+        use_current();
+    }
+
+protected:
+    /// Discards all data, keeps the segments for reuse.
+    void on_clear(size_t) noexcept override
+    {
+        m_sealed.clear();
+        m_sealed_size = 0;
+        m_segment_start = 0;
+        m_owners.clear();
+        m_current = 0;
+        if (m_storage.size() > 1 && m_storage[0].capacity > m_segment_capacity) {
+            // the segment joined by linearize(), not kept for the next data
+            m_storage.erase(m_storage.begin());
+        }
+        // a smaller first segment is replaced once it is too small for a reservation
+        reset_data(m_storage[0].data.get(), 0, m_storage[0].capacity);
+    }
+
+    size_t passed_on() const noexcept override { return m_sealed_size - m_segment_start; }
+
+    /// Nothing is passed on before clear(), a rewind into the sealed data drops the following
+    /// vectors and continues in the segment of the offset. The owners of the dropped spliced
+    /// data are kept until clear().
+    void rewind(const size_t offset) override
+    {
+        if (offset >= m_sealed_size) {
+            Buffer::rewind(offset);
+            return;
+        }
+        // the first vector to drop or cut, it contains the offset or starts at it
+        size_t index{m_sealed.size()};
+        size_t start{m_sealed_size};
+        while (start > offset) {
+            --index;
+            start -= m_sealed[index].iov_len;
+        }
+        size_t segment{segment_of(m_sealed[index].iov_base)};
+        size_t segment_start{0};
+        size_t data_size{0};
+        if (segment < m_storage.size()) {
+            segment_start = static_cast<size_t>(static_cast<char*>(m_sealed[index].iov_base)
+                                                - m_storage[segment].data.get());
+            data_size = segment_start + (offset - start);
+        } else {
+            if (start < offset) {
+                // the spliced data can't be cut
+                throw RollbackError{};
+            }
+            // after the last own data before it
+            segment = 0;
+            for (size_t previous{index}; previous > 0; --previous) {
+                const auto& vector = m_sealed[previous - 1];
+                segment = segment_of(vector.iov_base);
+                if (segment < m_storage.size()) {
+                    segment_start = static_cast<size_t>(static_cast<char*>(vector.iov_base)
+                                                        - m_storage[segment].data.get())
+                                    + vector.iov_len;
+                    break;
+                }
+                segment = 0;
+            }
+            data_size = segment_start;
+        }
+        m_sealed.resize(index);
+        m_sealed_size = start;
+        m_current = segment;
+        m_segment_start = segment_start;
+        reset_data(m_storage[segment].data.get(), data_size, m_storage[segment].capacity, 0);
+    }
+
+private:
+    struct Storage
+    {
+        explicit Storage(const size_t capacity_)
+            : data{new char[capacity_]}
+            , capacity{capacity_}
+        {
+        }
+
+        std::unique_ptr<char[]> data;
+        size_t capacity;
+    };
+
+    /// Moves the written part of the current segment to the sealed data.
+    void seal(const size_t data_size)
+    {
+        if (data_size > m_segment_start) {
+            m_sealed.push_back(iovec{data() + m_segment_start, data_size - m_segment_start});
+            m_sealed_size += data_size - m_segment_start;
+        }
+    }
+
+    /// Index of the segment holding the data, m_storage.size() for spliced data.
+    size_t segment_of(const void* const ptr) const noexcept
+    {
+        const auto* const chars = static_cast<const char*>(ptr);
+        for (size_t i{0}; i < m_storage.size(); ++i) {
+            const char* const begin = m_storage[i].data.get();
+            if (chars >= begin && chars < begin + m_storage[i].capacity) {
+                return i;
+            }
+        }
+        return m_storage.size();
+    }
+
+    /// Sets the current segment as the data, allocates it if needed.
+    void use_current()
+    {
+        if (m_current == m_storage.size()) {
+            m_storage.push_back(Storage{m_segment_capacity});
+        } else if (m_storage[m_current].capacity < m_segment_capacity) {
+            m_storage[m_current] = Storage{m_segment_capacity};
+        }
+        // may be smaller than a segment joined by linearize()
+        reset_data(m_storage[m_current].data.get(), 0, m_storage[m_current].capacity);
+    }
+
+    size_t m_segment_capacity;
+    std::vector<Storage> m_storage{};
+    /// index into m_storage
+    size_t m_current{0};
+    /// the part of the current segment which is in m_sealed already
+    size_t m_segment_start{0};
+    std::vector<iovec> m_sealed{};
+    size_t m_sealed_size{0};
+    std::vector<std::shared_ptr<const void>> m_owners{};
+};
+
+/// Already serialized JSON written as is. ChainBuffer splices large ones without copying and
+/// keeps the owner alive, the other buffers copy it.
+struct ExternalJson
+{
+    std::string_view json;
+    std::shared_ptr<const void> owner{};
+};
+
+template<>
+struct Formatter<ExternalJson>
+{
+    /// Smaller ones are cheaper to copy than to add an iovec.
+    static constexpr size_t MIN_SPLICE_SIZE{512};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const ExternalJson& value)
+    {
+        if constexpr (std::is_same_v<BufferType, ChainBuffer>) {
+            if (value.json.size() >= MIN_SPLICE_SIZE) {
+                buffer.splice(value.json.data(), value.json.size(), value.owner);
+                return;
+            }
+        }
+        // in pieces, the scratch spaces of e.g. FixedBuffer hold only the largest reservation
+        for (size_t offset{0}; offset < value.json.size();
+             offset += detail::MAX_CURSOR_RESERVATION) {
+            const auto count = std::min(value.json.size() - offset, detail::MAX_CURSOR_RESERVATION);
+            buffer.make_room(count);
+            buffer.consume(std::copy_n(value.json.data() + offset, count, buffer.working_end()));
+        }
+    }
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
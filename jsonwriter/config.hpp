@@ -0,0 +1,27 @@
+#pragma once
+#ifndef CONFIG_HPP__R7TQ2WXN
+#define CONFIG_HPP__R7TQ2WXN
+
+// Options changing the code or the layout of the library. The translation units of a program
+// may differ in them: the library is in an inline namespace named after the options, so the
+// linker doesn't merge the differing code, and the types can't be passed between such units.
+
+#ifndef JSONWRITER_INSTRUMENTATION
+/// Define as 1 before including the header to collect Buffer::stats().
+#define JSONWRITER_INSTRUMENTATION 0
+#endif
+
+#ifndef JSONWRITER_NON_FINITE
+/// NonFinite policy of the built-in float formatters. Define it before including the header to
+/// change it, e.g. `-DJSONWRITER_NON_FINITE=null`. Use FormatterFloat with an explicit policy
+/// for particular types.
+#define JSONWRITER_NON_FINITE passthrough
+#endif
+
+#define JSONWRITER_ABI_NAME(non_finite, instrumentation) abi_##non_finite##_##instrumentation
+#define JSONWRITER_ABI_EXPAND(non_finite, instrumentation) \
+    JSONWRITER_ABI_NAME(non_finite, instrumentation)
+/// The inline namespace of the library, e.g. jsonwriter::abi_passthrough_0.
+#define JSONWRITER_ABI JSONWRITER_ABI_EXPAND(JSONWRITER_NON_FINITE, JSONWRITER_INSTRUMENTATION)
+
+#endif /* include guard */
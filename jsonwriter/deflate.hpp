@@ -0,0 +1,119 @@
+#pragma once
+#ifndef DEFLATE_HPP__T6JX9BQN
+#define DEFLATE_HPP__T6JX9BQN
+
+// requires zlib (-lz)
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <stdexcept>
+#include <string>
+
+#include <zlib.h>
+
+#include <jsonwriter/sink.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+enum class DeflateFormat
+{
+    /// with the gzip header and trailer, e.g. for `Content-Encoding: gzip`
+    gzip,
+    /// with the zlib header and trailer, `Content-Encoding: deflate`
+    zlib,
+    /// without any header
+    raw,
+};
+
+/// Compresses the output on the fly: each full chunk is fed to the zlib stream and the
+/// compressed data goes straight to the target buffer, e.g. an FdBuffer. The uncompressed
+/// document never exists in full. The chunk size trades the deflate call overhead against the
+/// cache residency. Call finish() at the end, the destructor finishes too but ignores errors.
+class DeflateBuffer : public SinkBuffer<DeflateBuffer>
+{
+public:
+    /// Throws std::runtime_error.
+    explicit DeflateBuffer(Buffer& target, const DeflateFormat format = DeflateFormat::gzip,
+                           const int level = Z_DEFAULT_COMPRESSION,
+                           const size_t chunk_size = size_t{64} << 10)
+        : SinkBuffer{chunk_size}
+        , m_target{target}
+    {
+        const int window_bits{format == DeflateFormat::gzip   ? 15 + 16
+                              : format == DeflateFormat::zlib ? 15
+                                                              : -15};
+        if (deflateInit2(&m_stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY)
+            != Z_OK) {
+            throw std::runtime_error{"deflateInit2 failed"};
+        }
+    }
+
+    ~DeflateBuffer() override
+    {
+        try {
+            finish();
+        } catch (...) {
+        }
+        deflateEnd(&m_stream);
+    }
+
+    /// Compresses the rest and ends the stream. The buffer is not usable afterwards.
+    /// Throws std::runtime_error.
+    void finish()
+    {
+        if (m_finished) {
+            return;
+        }
+        flush();
+        m_finished = true;
+        compress(Z_FINISH);
+    }
+
+    /// Number of compressed bytes passed to the target.
+    size_t compressed() const noexcept { return m_stream.total_out; }
+
+    void write_out(const char* const data, const size_t size)
+    {
+        assert(!m_finished);
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        for (size_t left{size}; left > 0;) {
+            const auto part = static_cast<uInt>(std::min<size_t>(left, UINT_MAX));
+            m_stream.avail_in = part;
+            compress(Z_NO_FLUSH);
+            left -= part;
+        }
+    }
+
+private:
+    /// Deflates into the room of the target until all input is consumed or the stream ends.
+    void compress(const int flush)
+    {
+        static constexpr size_t OUTPUT_ROOM{16 * 1024};
+
+        for (;;) {
+            m_target.make_room(OUTPUT_ROOM);
+            m_stream.next_out = reinterpret_cast<Bytef*>(m_target.working_end());
+            m_stream.avail_out = static_cast<uInt>(std::min<size_t>(m_target.room(), UINT_MAX));
+            const int result{deflate(&m_stream, flush)};
+            if (result == Z_STREAM_ERROR) {
+                throw std::runtime_error{std::string{"deflate failed: "}
+                                         + (m_stream.msg != nullptr ? m_stream.msg : "")};
+            }
+            m_target.consume(reinterpret_cast<char*>(m_stream.next_out));
+            if (flush == Z_FINISH ? result == Z_STREAM_END : m_stream.avail_out != 0) {
+                return;
+            }
+        }
+    }
+
+    Buffer& m_target;
+    z_stream m_stream{};
+    bool m_finished{false};
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
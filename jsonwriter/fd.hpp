@@ -0,0 +1,83 @@
+#pragma once
+#ifndef FD_HPP__P2HV6TQK
+#define FD_HPP__P2HV6TQK
+
+// POSIX only
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <system_error>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <jsonwriter/sink.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+namespace detail {
+
+/// Writes all the vectors, continues after partial writes and interrupts. The vectors are
+/// modified. Throws std::system_error.
+inline void write_all(const int fd, iovec* iov, size_t count)
+{
+    while (count > 0) {
+        const auto written = ::writev(fd, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX)));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error{errno, std::generic_category(), "writev"};
+        }
+        auto left = static_cast<size_t>(written);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+}
+
+} // namespace detail
+
+/// Streams the output to a file descriptor (file, pipe, socket) in chunks, the memory stays
+/// bounded regardless of the document size. The descriptor is not owned. Call flush() at the
+/// end, the destructor flushes too but ignores errors.
+class FdBuffer : public SinkBuffer<FdBuffer>
+{
+public:
+    explicit FdBuffer(const int fd, const size_t chunk_size = size_t{1} << 20)
+        : SinkBuffer{chunk_size}
+        , m_fd{fd}
+    {
+    }
+
+    ~FdBuffer() override
+    {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+    /// Throws std::system_error.
+    void write_out(const char* const data, const size_t size)
+    {
+        iovec iov{const_cast<char*>(data), size};
+        detail::write_all(m_fd, &iov, 1);
+    }
+
+private:
+    int m_fd;
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
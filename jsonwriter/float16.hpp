@@ -0,0 +1,353 @@
+#pragma once
+#ifndef FLOAT16_HPP__K3Q8ZT1M
+#define FLOAT16_HPP__K3Q8ZT1M
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include <jsonwriter/config.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+/// IEEE 754 binary16 (half precision) number given by its bit pattern.
+struct Float16
+{
+    uint16_t bits;
+};
+
+/// bfloat16 number (the upper half of IEEE 754 binary32) given by its bit pattern.
+struct BFloat16
+{
+    uint16_t bits;
+};
+
+namespace detail {
+
+template<typename T>
+struct Float16Format;
+
+template<>
+struct Float16Format<Float16>
+{
+    static constexpr int significand_bits{10};
+    static constexpr int exponent_bits{5};
+    // sign(1) + significand(5) + decimal_point(1) + exp_marker(1) + exp_sign(1) + exp(1)
+    static constexpr size_t max_output_length{1 + 5 + 1 + 1 + 1 + 1};
+};
+
+template<>
+struct Float16Format<BFloat16>
+{
+    static constexpr int significand_bits{7};
+    static constexpr int exponent_bits{8};
+    // sign(1) + significand(4) + decimal_point(1) + exp_marker(1) + exp_sign(1) + exp(2)
+    static constexpr size_t max_output_length{1 + 4 + 1 + 1 + 1 + 2};
+};
+
+/// Just enough of an unsigned big integer for the exact digit generation of 16-bit floats.
+/// The largest intermediate value (a bfloat16 subnormal scaled by 10^45) fits in 160 bits.
+class BigUint
+{
+public:
+    explicit BigUint(const uint32_t value) { m_limbs[0] = value; }
+
+    void mul_small(const uint32_t factor)
+    {
+        uint64_t carry{0};
+        for (auto& limb : m_limbs) {
+            carry += uint64_t{limb} * factor;
+            limb = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+    }
+
+    void mul_pow2(int exponent)
+    {
+        for (; exponent >= 31; exponent -= 31) {
+            mul_small(uint32_t{1} << 31);
+        }
+        mul_small(uint32_t{1} << exponent);
+    }
+
+    void mul_pow10(int exponent)
+    {
+        for (; exponent >= 9; exponent -= 9) {
+            mul_small(1'000'000'000);
+        }
+        for (; exponent > 0; --exponent) {
+            mul_small(10);
+        }
+    }
+
+    /// Replaces the value by the remainder and returns the quotient. The quotient must be small.
+    uint32_t divide_small(const BigUint& divisor)
+    {
+        uint32_t quotient{0};
+        while (compare(*this, divisor) >= 0) {
+            *this -= divisor;
+            ++quotient;
+        }
+        return quotient;
+    }
+
+    BigUint& operator+=(const BigUint& other)
+    {
+        uint64_t carry{0};
+        for (size_t i{0}; i < LIMBS; ++i) {
+            carry += uint64_t{m_limbs[i]} + other.m_limbs[i];
+            m_limbs[i] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        return *this;
+    }
+
+    /// Requires *this >= other.
+    BigUint& operator-=(const BigUint& other)
+    {
+        uint64_t borrow{0};
+        for (size_t i{0}; i < LIMBS; ++i) {
+            const uint64_t sub = uint64_t{other.m_limbs[i]} + borrow;
+            borrow = m_limbs[i] < sub ? 1 : 0;
+            m_limbs[i] = static_cast<uint32_t>(m_limbs[i] - sub);
+        }
+        return *this;
+    }
+
+    friend int compare(const BigUint& a, const BigUint& b)
+    {
+        for (size_t i{LIMBS}; i-- > 0;) {
+            if (a.m_limbs[i] != b.m_limbs[i]) {
+                return a.m_limbs[i] < b.m_limbs[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    friend BigUint operator+(BigUint a, const BigUint& b) { return a += b; }
+
+private:
+    static constexpr size_t LIMBS{5};
+    uint32_t m_limbs[LIMBS]{};
+};
+
+/// The same interface as BigUint for the values which fit in 64 bits. It covers all
+/// binary16 numbers and bfloat16 numbers of magnitudes which are not extreme.
+class SmallUint
+{
+public:
+    /// Binary exponents of the values which don't overflow 64 bits during the digit generation.
+    static constexpr int MIN_EXPONENT{-50};
+    static constexpr int MAX_EXPONENT{36};
+
+    explicit SmallUint(const uint32_t value)
+        : m_value{value}
+    {
+    }
+
+    void mul_small(const uint32_t factor) { m_value *= factor; }
+    void mul_pow2(const int exponent) { m_value <<= exponent; }
+    void mul_pow10(const int exponent)
+    {
+        static constexpr uint64_t powers[] = {1ull,
+                                              10ull,
+                                              100ull,
+                                              1000ull,
+                                              10000ull,
+                                              100000ull,
+                                              1000000ull,
+                                              10000000ull,
+                                              100000000ull,
+                                              1000000000ull,
+                                              10000000000ull,
+                                              100000000000ull,
+                                              1000000000000ull,
+                                              10000000000000ull,
+                                              100000000000000ull,
+                                              1000000000000000ull,
+                                              10000000000000000ull};
+        assert(exponent >= 0 && exponent < static_cast<int>(std::size(powers)));
+        m_value *= powers[exponent];
+    }
+
+    uint32_t divide_small(const SmallUint& divisor)
+    {
+        const auto quotient = static_cast<uint32_t>(m_value / divisor.m_value);
+        m_value %= divisor.m_value;
+        return quotient;
+    }
+
+    SmallUint& operator+=(const SmallUint& other)
+    {
+        m_value += other.m_value;
+        return *this;
+    }
+
+    SmallUint& operator-=(const SmallUint& other)
+    {
+        m_value -= other.m_value;
+        return *this;
+    }
+
+    friend int compare(const SmallUint& a, const SmallUint& b)
+    {
+        return a.m_value < b.m_value ? -1 : (a.m_value > b.m_value ? 1 : 0);
+    }
+
+    friend SmallUint operator+(SmallUint a, const SmallUint& b) { return a += b; }
+
+private:
+    uint64_t m_value;
+};
+
+} // namespace detail
+
+/// Shortest decimal representation which rounds back to the same 16-bit float. Such a value
+/// has at most 5 significant digits so the wide float formatters would be needlessly long.
+class FormatFloat16
+{
+public:
+    /// value = significand * 10^exponent
+    struct Decimal
+    {
+        uint32_t significand;
+        int exponent;
+    };
+
+    /// Only for finite non-zero values. The sign is ignored.
+    template<typename T>
+    static Decimal to_decimal(const T value)
+    {
+        using Format = detail::Float16Format<T>;
+        constexpr int bias{(1 << (Format::exponent_bits - 1)) - 1};
+        constexpr uint32_t exponent_mask{(1u << Format::exponent_bits) - 1};
+        constexpr uint32_t significand_mask{(1u << Format::significand_bits) - 1};
+
+        const uint32_t exponent_bits{(uint32_t{value.bits} >> Format::significand_bits)
+                                     & exponent_mask};
+        const uint32_t significand_bits{uint32_t{value.bits} & significand_mask};
+        assert(exponent_bits != exponent_mask);
+        assert(exponent_bits != 0 || significand_bits != 0);
+
+        // value = f * 2^e
+        uint32_t f{significand_bits};
+        int e{1 - bias - Format::significand_bits};
+        if (exponent_bits != 0) {
+            f |= 1u << Format::significand_bits;
+            e = static_cast<int>(exponent_bits) - bias - Format::significand_bits;
+        }
+        // the gap to the lower neighbour is half of the upper one at a power of 2
+        const bool lower_closer{significand_bits == 0 && exponent_bits > 1};
+        // round-to-nearest-even parsers map boundaries to the even significand
+        const bool include_bounds{f % 2 == 0};
+
+        if (e >= detail::SmallUint::MIN_EXPONENT && e <= detail::SmallUint::MAX_EXPONENT) {
+            return generate_digits<detail::SmallUint>(f, e, lower_closer, include_bounds);
+        }
+        return generate_digits<detail::BigUint>(f, e, lower_closer, include_bounds);
+    }
+
+private:
+    /// Free-format (shortest) digit generation by Steele & White, Burger & Dybvig.
+    /// value = r / s, the rounding interval is (r - m_minus, r + m_plus) / s.
+    template<typename Uint>
+    static Decimal generate_digits(const uint32_t f, const int e, const bool lower_closer,
+                                   const bool include_bounds)
+    {
+        const int shift{lower_closer ? 2 : 1};
+        Uint r{f << shift};
+        Uint s{1u << (shift - 1)};
+        Uint m_plus{lower_closer ? 2u : 1u};
+        Uint m_minus{1};
+        if (e >= 0) {
+            r.mul_pow2(e);
+            m_plus.mul_pow2(e);
+            m_minus.mul_pow2(e);
+        } else {
+            s.mul_pow2(-e);
+        }
+        s.mul_small(2);
+
+        // estimate of floor(log10(value)), refined below
+        int k{floor_log10_pow2(e + bit_length(f) - 1)};
+        if (k >= 0) {
+            s.mul_pow10(k);
+        } else {
+            r.mul_pow10(-k);
+            m_plus.mul_pow10(-k);
+            m_minus.mul_pow10(-k);
+        }
+
+        // find k such that the upper bound is in [10^(k-1), 10^k) * s
+        const auto high_reached = [include_bounds](const Uint& high, const Uint& limit) {
+            const int cmp{compare(high, limit)};
+            return include_bounds ? cmp >= 0 : cmp > 0;
+        };
+        while (high_reached(r + m_plus, s)) {
+            s.mul_small(10);
+            ++k;
+        }
+        for (;;) {
+            auto high = r + m_plus;
+            high.mul_small(10);
+            if (high_reached(high, s)) {
+                break;
+            }
+            r.mul_small(10);
+            m_plus.mul_small(10);
+            m_minus.mul_small(10);
+            --k;
+        }
+
+        uint32_t significand{0};
+        for (;;) {
+            r.mul_small(10);
+            m_plus.mul_small(10);
+            m_minus.mul_small(10);
+            --k;
+
+            uint32_t digit{r.divide_small(s)};
+
+            const int cmp_low{compare(r, m_minus)};
+            const bool low{include_bounds ? cmp_low <= 0 : cmp_low < 0};
+            const bool high{high_reached(r + m_plus, s)};
+
+            if (low && high) {
+                // pick the closer one, ties to even
+                auto twice_r = r;
+                twice_r.mul_small(2);
+                const int cmp{compare(twice_r, s)};
+                if (cmp > 0 || (cmp == 0 && digit % 2 == 1)) {
+                    ++digit;
+                }
+            } else if (high) {
+                ++digit;
+            }
+            significand = significand * 10 + digit;
+            if (low || high) {
+                break;
+            }
+        }
+
+        return Decimal{significand, k};
+    }
+
+    static int bit_length(uint32_t value)
+    {
+        int length{0};
+        for (; value != 0; value >>= 1) {
+            ++length;
+        }
+        return length;
+    }
+
+    /// floor(e * log10(2)), valid for |e| < 1700
+    static int floor_log10_pow2(const int e) { return (e * 315653) >> 20; }
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
@@ -6,7 +6,10 @@
 #include <string_view>
 #include <type_traits>
 
+#include <jsonwriter/config.hpp>
+
 namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
 
 class FormatInt
 {
@@ -91,6 +94,7 @@ private:
     }
 };
 
+} // inline namespace JSONWRITER_ABI
 } // namespace jsonwriter
 
 #endif /* include guard */
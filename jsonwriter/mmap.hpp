@@ -0,0 +1,225 @@
+#pragma once
+#ifndef MMAP_HPP__Z5CF1NRD
+#define MMAP_HPP__Z5CF1NRD
+
+// POSIX only
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <jsonwriter/writer.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+namespace detail {
+
+[[noreturn]] inline void throw_errno(const char* const what)
+{
+    throw std::system_error{errno, std::generic_category(), what};
+}
+
+inline size_t page_size()
+{
+    static const auto size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+inline size_t round_up_to_pages(const size_t size)
+{
+    const size_t page{page_size()};
+    return (size + page - 1) / page * page;
+}
+
+/// Moves the mapping to a larger size, by the page tables if possible.
+inline void* remap(void* const old_ptr, const size_t old_size, const size_t new_size, const int fd)
+{
+#ifdef MREMAP_MAYMOVE
+    static_cast<void>(fd);
+    void* const ptr = ::mremap(old_ptr, old_size, new_size, MREMAP_MAYMOVE);
+#else
+    void* const ptr = fd < 0 ? ::mmap(nullptr, new_size, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                             : ::mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr != MAP_FAILED) {
+        if (fd < 0) {
+            ::memcpy(ptr, old_ptr, old_size);
+        }
+        ::munmap(old_ptr, old_size);
+    }
+#endif
+    if (ptr == MAP_FAILED) {
+        throw_errno("mremap");
+    }
+    return ptr;
+}
+
+} // namespace detail
+
+/// Serializes straight into the page cache of a file. The file is extended by ftruncate() and
+/// remapped on growth, there is no copying of the data. close() cuts the file to the written
+/// size. Not movable.
+class MappedFileBuffer : public BufferImpl<MappedFileBuffer>
+{
+public:
+    /// Creates or truncates the file. Throws std::system_error.
+    explicit MappedFileBuffer(const char* const path,
+                              const size_t initial_capacity = size_t{1} << 20)
+        : m_fd{::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)}
+        , m_capacity{detail::round_up_to_pages(std::max(initial_capacity, size_t{1}))}
+    {
+        if (m_fd < 0) {
+            detail::throw_errno("open");
+        }
+        if (::ftruncate(m_fd, static_cast<off_t>(m_capacity)) != 0) {
+            const auto error = errno;
+            ::close(m_fd);
+            throw std::system_error{error, std::generic_category(), "ftruncate"};
+        }
+        void* const ptr = ::mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (ptr == MAP_FAILED) {
+            const auto error = errno;
+            ::close(m_fd);
+            throw std::system_error{error, std::generic_category(), "mmap"};
+        }
+        set_data(static_cast<char*>(ptr), 0, m_capacity);
+    }
+
+    MappedFileBuffer(const MappedFileBuffer&) = delete;
+    MappedFileBuffer& operator=(const MappedFileBuffer&) = delete;
+    MappedFileBuffer(MappedFileBuffer&&) = delete;
+    MappedFileBuffer& operator=(MappedFileBuffer&&) = delete;
+
+    /// Closes the file, errors are ignored.
+    ~MappedFileBuffer() override
+    {
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+
+    /// Cuts the file to the written size and closes it. The buffer is not usable afterwards.
+    /// Throws std::system_error.
+    void close()
+    {
+        if (m_fd < 0) {
+            return;
+        }
+        // the file starts with the data
+        if (headroom() > 0) {
+            ::memmove(mapping(), data(), size());
+        }
+        const auto data_size = size();
+        ::munmap(mapping(), m_capacity);
+        set_data(nullptr, 0, m_capacity);
+        const int fd{m_fd};
+        m_fd = -1;
+        const bool truncated{::ftruncate(fd, static_cast<off_t>(data_size)) == 0};
+        const auto error = errno;
+        if (::close(fd) != 0 && truncated) {
+            detail::throw_errno("close");
+        }
+        if (!truncated) {
+            throw std::system_error{error, std::generic_category(), "ftruncate"};
+        }
+    }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        assert(m_fd >= 0);
+        const auto bulk_new_capacity = detail::round_up_to_pages(
+            std::max(new_capacity, m_capacity + m_capacity / 2));
+        if (::ftruncate(m_fd, static_cast<off_t>(bulk_new_capacity)) != 0) {
+            detail::throw_errno("ftruncate");
+        }
+        void* const ptr = detail::remap(mapping(), m_capacity, bulk_new_capacity, m_fd);
+        m_capacity = bulk_new_capacity;
+        set_data(static_cast<char*>(ptr), data_size, m_capacity);
+    }
+
+private:
+    /// The beginning of the mapping, in front of the headroom.
+    char* mapping() noexcept { return data() - headroom(); }
+
+    int m_fd;
+    size_t m_capacity;
+};
+
+/// Growing buffer in anonymous memory. The growth moves the page tables by mremap() instead of
+/// copying the data like SimpleBuffer does, which matters for large documents. Optionally backed
+/// by transparent huge pages. Not movable.
+class MmapBuffer : public BufferImpl<MmapBuffer>
+{
+public:
+    /// Throws std::system_error.
+    explicit MmapBuffer(const size_t initial_capacity = size_t{64} << 10,
+                        const bool huge_pages = false)
+        : m_huge_pages{huge_pages}
+        , m_capacity{round_up(std::max(initial_capacity, size_t{1}))}
+    {
+        void* const ptr = ::mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            detail::throw_errno("mmap");
+        }
+        advise(ptr);
+        set_data(static_cast<char*>(ptr), 0, m_capacity);
+    }
+
+    MmapBuffer(const MmapBuffer&) = delete;
+    MmapBuffer& operator=(const MmapBuffer&) = delete;
+    MmapBuffer(MmapBuffer&&) = delete;
+    MmapBuffer& operator=(MmapBuffer&&) = delete;
+
+    ~MmapBuffer() override { ::munmap(mapping(), m_capacity); }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        const auto bulk_new_capacity = round_up(
+            std::max(new_capacity, m_capacity + m_capacity / 2));
+        void* const ptr = detail::remap(mapping(), m_capacity, bulk_new_capacity, -1);
+        m_capacity = bulk_new_capacity;
+        advise(ptr);
+        set_data(static_cast<char*>(ptr), data_size, m_capacity);
+    }
+
+private:
+    static constexpr size_t HUGE_PAGE_SIZE{size_t{2} << 20};
+
+    /// The beginning of the mapping, in front of the headroom.
+    char* mapping() noexcept { return data() - headroom(); }
+
+    size_t round_up(const size_t size) const
+    {
+        if (m_huge_pages) {
+            return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        }
+        return detail::round_up_to_pages(size);
+    }
+
+    /// Best effort, the kernel may not support it.
+    void advise([[maybe_unused]] void* const ptr) const
+    {
+#ifdef MADV_HUGEPAGE
+        if (m_huge_pages) {
+            ::madvise(ptr, m_capacity, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    const bool m_huge_pages;
+    size_t m_capacity;
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef PMR_HPP__H6YG0VKC
+#define PMR_HPP__H6YG0VKC
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory_resource>
+#include <utility>
+
+#include <jsonwriter/writer.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+/// Growing buffer allocating from a memory resource, e.g. a per-request arena. The resource
+/// must outlive the buffer. Moved-from instance behavior is undefined.
+class PmrBuffer : public BufferImpl<PmrBuffer>
+{
+public:
+    explicit PmrBuffer(std::pmr::memory_resource* const resource,
+                       const size_t initial_capacity = 1024)
+        : m_resource{resource}
+        , m_capacity{std::max(initial_capacity, size_t{1})}
+        , m_ptr{static_cast<char*>(m_resource->allocate(m_capacity, 1))}
+    {
+        set_data(m_ptr, 0, m_capacity);
+    }
+
+    PmrBuffer(PmrBuffer&& other) noexcept
+        : BufferImpl{std::move(other)}
+        , m_resource{other.m_resource}
+        , m_capacity{other.m_capacity}
+        , m_ptr{std::exchange(other.m_ptr, nullptr)}
+    {
+    }
+
+    PmrBuffer& operator=(PmrBuffer&&) = delete;
+
+    ~PmrBuffer() override
+    {
+        if (m_ptr != nullptr) {
+            m_resource->deallocate(m_ptr, m_capacity, 1);
+        }
+    }
+
+    std::pmr::memory_resource* resource() const noexcept { return m_resource; }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        // should be only growing
+        assert(new_capacity >= m_capacity);
+
+        const auto bulk_new_capacity = std::max(new_capacity, m_capacity + m_capacity / 2);
+        auto* const new_ptr = static_cast<char*>(m_resource->allocate(bulk_new_capacity, 1));
+        ::memcpy(new_ptr, m_ptr, data_size);
+        record_copy(data_size);
+        m_resource->deallocate(m_ptr, m_capacity, 1);
+
+        m_ptr = new_ptr;
+        m_capacity = bulk_new_capacity;
+        set_data(m_ptr, data_size, m_capacity);
+    }
+
+private:
+    std::pmr::memory_resource* m_resource;
+    size_t m_capacity;
+    char* m_ptr;
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
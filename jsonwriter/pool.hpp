@@ -0,0 +1,275 @@
+#pragma once
+#ifndef POOL_HPP__R7MW2XQE
+#define POOL_HPP__R7MW2XQE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <jsonwriter/writer.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+class PooledBuffer;
+
+/// Reuses heap blocks of the buffers, e.g. one buffer per request. A released block keeps its
+/// grown capacity so the steady state does no allocation. Released blocks go to a cache of the
+/// releasing thread and then to a lock-free global free list shared by all threads. The global
+/// list retains at most max_retained_blocks blocks. The pool must outlive its buffers.
+class BufferPool : private detail::NoCopyMove
+{
+public:
+    /// Blocks of buffers which grew over max_retained_capacity are freed on release.
+    explicit BufferPool(const size_t initial_capacity = 4096,
+                        const size_t max_retained_capacity = size_t{1} << 20,
+                        const size_t max_retained_blocks = 1024)
+        : m_initial_capacity{initial_capacity}
+        , m_max_retained_capacity{max_retained_capacity}
+        , m_id{next_id()}
+        , m_slots{new Slot[max_retained_blocks]}
+    {
+        assert(initial_capacity > 0);
+        assert(max_retained_blocks < NONE);
+        // all slots are empty
+        for (size_t i{0}; i < max_retained_blocks; ++i) {
+            m_slots[i].next.store(i + 1 < max_retained_blocks ? static_cast<uint32_t>(i + 1) : NONE,
+                                  std::memory_order_relaxed);
+        }
+        m_empty.store(max_retained_blocks > 0 ? 0 : NONE, std::memory_order_relaxed);
+    }
+
+    ~BufferPool()
+    {
+        // the blocks left in the thread caches are freed by the threads
+        for (auto index = pop(m_free); index != NONE; index = pop(m_free)) {
+            free_block(m_slots[index].block);
+        }
+    }
+
+    /// An empty buffer. Thread-safe.
+    PooledBuffer acquire();
+
+    /// Number of blocks allocated from the heap so far.
+    size_t allocations() const noexcept { return m_allocations.load(std::memory_order_relaxed); }
+
+private:
+    friend class PooledBuffer;
+
+    struct Block
+    {
+        size_t capacity;
+
+        char* data() noexcept { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    /// A few blocks of the last pool used by the thread, without any synchronization.
+    struct ThreadCache
+    {
+        static constexpr size_t SIZE{8};
+
+        uint64_t pool_id{0};
+        size_t count{0};
+        std::array<Block*, SIZE> blocks{};
+
+        ~ThreadCache()
+        {
+            for (size_t i{0}; i < count; ++i) {
+                free_block(blocks[i]);
+            }
+        }
+    };
+
+    /// Node of the global lists. The slots live as long as the pool, so a pop can read the next
+    /// index of a slot which was taken meanwhile, unlike a list of the blocks themselves.
+    struct Slot
+    {
+        std::atomic<uint32_t> next{NONE};
+        Block* block{nullptr};
+    };
+
+    static constexpr uint32_t NONE{std::numeric_limits<uint32_t>::max()};
+
+    static uint64_t next_id()
+    {
+        static std::atomic<uint64_t> last_id{0};
+        return ++last_id;
+    }
+
+    static ThreadCache& thread_cache()
+    {
+        static thread_local ThreadCache cache{};
+        return cache;
+    }
+
+    Block* allocate(const size_t capacity)
+    {
+        m_allocations.fetch_add(1, std::memory_order_relaxed);
+        auto* block = static_cast<Block*>(::operator new(sizeof(Block) + capacity));
+        block->capacity = capacity;
+        return block;
+    }
+
+    static void free_block(Block* const block) noexcept { ::operator delete(block); }
+
+    Block* take()
+    {
+        auto& cache = thread_cache();
+        if (cache.pool_id == m_id && cache.count > 0) {
+            return cache.blocks[--cache.count];
+        }
+
+        // A single block, spare blocks parked in this thread's cache would be allocated anew
+        // by the other threads.
+        const auto index = pop(m_free);
+        if (index == NONE) {
+            return allocate(m_initial_capacity);
+        }
+        Block* const block = m_slots[index].block;
+        push(m_empty, index);
+        return block;
+    }
+
+    void give_back(Block* const block)
+    {
+        if (block->capacity > m_max_retained_capacity) {
+            free_block(block);
+            return;
+        }
+        auto& cache = thread_cache();
+        if (cache.count == 0) {
+            cache.pool_id = m_id;
+        }
+        if (cache.pool_id == m_id && cache.count < ThreadCache::SIZE) {
+            cache.blocks[cache.count++] = block;
+            return;
+        }
+        const auto index = pop(m_empty);
+        if (index == NONE) {
+            free_block(block);
+            return;
+        }
+        m_slots[index].block = block;
+        push(m_free, index);
+    }
+
+    /// The list heads are a slot index in the low half and a generation in the high half, which
+    /// changes on every update so a stale head never matches (ABA).
+    static uint64_t make_head(const uint64_t old_head, const uint32_t index) noexcept
+    {
+        return ((old_head >> 32) + 1) << 32 | index;
+    }
+
+    uint32_t pop(std::atomic<uint64_t>& head) noexcept
+    {
+        uint64_t old_head = head.load(std::memory_order_acquire);
+        for (;;) {
+            const auto index = static_cast<uint32_t>(old_head);
+            if (index == NONE) {
+                return NONE;
+            }
+            const auto next = m_slots[index].next.load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(old_head, make_head(old_head, next),
+                                           std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+                return index;
+            }
+        }
+    }
+
+    void push(std::atomic<uint64_t>& head, const uint32_t index) noexcept
+    {
+        uint64_t old_head = head.load(std::memory_order_relaxed);
+        do {
+            m_slots[index].next.store(static_cast<uint32_t>(old_head), std::memory_order_relaxed);
+        } while (!head.compare_exchange_weak(old_head, make_head(old_head, index),
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+    }
+
+    const size_t m_initial_capacity;
+    const size_t m_max_retained_capacity;
+    const uint64_t m_id;
+    std::unique_ptr<Slot[]> m_slots;
+    /// slots holding a block
+    std::atomic<uint64_t> m_free{NONE};
+    /// slots for the released blocks
+    std::atomic<uint64_t> m_empty{NONE};
+    std::atomic<size_t> m_allocations{0};
+};
+
+/// Buffer lease from BufferPool. The block returns to the pool on destruction.
+/// Moved-from instance behavior is undefined.
+class PooledBuffer : public BufferImpl<PooledBuffer>
+{
+public:
+    PooledBuffer(PooledBuffer&& other) noexcept
+        : BufferImpl{std::move(other)}
+        , m_pool{other.m_pool}
+        , m_block{std::exchange(other.m_block, nullptr)}
+    {
+    }
+
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept
+    {
+        if (&other != this) {
+            release();
+            BufferImpl::operator=(std::move(other));
+            m_pool = other.m_pool;
+            m_block = std::exchange(other.m_block, nullptr);
+        }
+        return *this;
+    }
+
+    ~PooledBuffer() override { release(); }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        // should be only growing
+        assert(new_capacity >= m_block->capacity);
+
+        const auto bulk_new_capacity = std::max(new_capacity,
+                                                m_block->capacity + m_block->capacity / 2);
+        auto* const new_block = m_pool->allocate(bulk_new_capacity);
+        ::memcpy(new_block->data(), m_block->data(), data_size);
+        record_copy(data_size);
+        // the smaller block is not worth retaining
+        BufferPool::free_block(std::exchange(m_block, new_block));
+
+        set_data(m_block->data(), data_size, m_block->capacity);
+    }
+
+private:
+    friend class BufferPool;
+
+    PooledBuffer(BufferPool& pool, BufferPool::Block* const block)
+        : m_pool{&pool}
+        , m_block{block}
+    {
+        set_data(m_block->data(), 0, m_block->capacity);
+    }
+
+    void release() noexcept
+    {
+        if (m_block != nullptr) {
+            m_pool->give_back(std::exchange(m_block, nullptr));
+        }
+    }
+
+    BufferPool* m_pool;
+    BufferPool::Block* m_block;
+};
+
+inline PooledBuffer BufferPool::acquire() { return PooledBuffer{*this, take()}; }
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
@@ -0,0 +1,189 @@
+#pragma once
+#ifndef SINK_HPP__E4NB8WUA
+#define SINK_HPP__E4NB8WUA
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include <jsonwriter/writer.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+/// Base of the buffers streaming the output somewhere instead of keeping the whole document.
+/// When the room is exhausted the data is passed to Derived::write_out(const char*, size_t) and
+/// the buffer starts over, so the memory stays bounded by the chunk size. It grows only if a
+/// single reservation is larger than the chunk. The writing hot path is the one of BufferImpl.
+/// Derived classes should call flush() at the end, the destructor can't do it.
+template<typename Derived>
+class SinkBuffer : public BufferImpl<Derived>
+{
+public:
+    SinkBuffer(const SinkBuffer&) = delete;
+    SinkBuffer& operator=(const SinkBuffer&) = delete;
+    SinkBuffer(SinkBuffer&&) = delete;
+    SinkBuffer& operator=(SinkBuffer&&) = delete;
+
+    /// Passes all buffered data to Derived::write_out().
+    void flush()
+    {
+        if (this->size() > 0) {
+            static_cast<Derived&>(*this).write_out(this->data(), this->size());
+            m_flushed += this->size();
+            this->clear();
+        }
+    }
+
+    /// Number of bytes passed to Derived::write_out() so far.
+    size_t flushed() const noexcept { return m_flushed; }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        assert(data_size == this->headroom() + this->size());
+        const size_t needed = new_capacity - data_size;
+        flush();
+        if (needed > m_capacity) {
+            m_storage.reset(new char[needed]);
+            m_capacity = needed;
+        }
+        this->set_data(m_storage.get(), 0, m_capacity);
+    }
+
+protected:
+    explicit SinkBuffer(const size_t chunk_size)
+        : m_storage{new char[std::max(chunk_size, size_t{1})]}
+        , m_capacity{std::max(chunk_size, size_t{1})}
+    {
+        this->set_data(m_storage.get(), 0, m_capacity);
+    }
+
+    ~SinkBuffer() override = default;
+
+    size_t passed_on() const noexcept override { return m_flushed; }
+
+private:
+    std::unique_ptr<char[]> m_storage;
+    size_t m_capacity;
+    size_t m_flushed{0};
+};
+
+/// Base of the sinks writing the chunks asynchronously. A full chunk is passed to
+/// Derived::submit(chunk, data, size, offset) and the writing continues in the next chunk while
+/// the previous one is written. Derived::wait(chunk) must block until the submission of the
+/// chunk completes. It blocks only when all chunks are in flight. offset is the position of
+/// the data in the output, the chunks are submitted in a round-robin order. The derived
+/// destructors must call drain().
+template<typename Derived>
+class AsyncSinkBuffer : public BufferImpl<Derived>
+{
+public:
+    AsyncSinkBuffer(const AsyncSinkBuffer&) = delete;
+    AsyncSinkBuffer& operator=(const AsyncSinkBuffer&) = delete;
+    AsyncSinkBuffer(AsyncSinkBuffer&&) = delete;
+    AsyncSinkBuffer& operator=(AsyncSinkBuffer&&) = delete;
+
+    /// Submits the buffered data and waits until all of it is written.
+    void flush()
+    {
+        submit_current();
+        for (size_t i{0}; i < m_chunks.size(); ++i) {
+            wait_chunk(i);
+        }
+        this->set_data(m_chunks[m_current].get(), 0, m_chunk_capacity);
+    }
+
+    /// Number of bytes submitted so far.
+    size_t flushed() const noexcept { return m_flushed; }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        assert(data_size == this->headroom() + this->size());
+        const size_t needed = new_capacity - data_size;
+        submit_current();
+        wait_chunk(m_current);
+        if (needed > m_chunk_capacity) {
+            for (size_t i{0}; i < m_chunks.size(); ++i) {
+                wait_chunk(i);
+            }
+            m_chunk_capacity = needed;
+            for (auto& chunk : m_chunks) {
+                chunk.reset(new char[m_chunk_capacity]);
+            }
+            static_cast<Derived&>(*this).chunks_changed();
+        }
+        this->set_data(m_chunks[m_current].get(), 0, m_chunk_capacity);
+    }
+
+protected:
+    AsyncSinkBuffer(const size_t chunk_size, const size_t chunk_count)
+        : m_chunk_capacity{std::max(chunk_size, size_t{1})}
+        , m_chunks(std::max(chunk_count, size_t{2}))
+        , m_in_flight(m_chunks.size(), false)
+    {
+        for (auto& chunk : m_chunks) {
+            chunk.reset(new char[m_chunk_capacity]);
+        }
+        this->set_data(m_chunks[m_current].get(), 0, m_chunk_capacity);
+    }
+
+    ~AsyncSinkBuffer() override = default;
+
+    size_t passed_on() const noexcept override { return m_flushed; }
+
+    size_t chunk_count() const noexcept { return m_chunks.size(); }
+    char* chunk(const size_t index) noexcept { return m_chunks[index].get(); }
+    size_t chunk_capacity() const noexcept { return m_chunk_capacity; }
+
+    /// Called after the chunks were reallocated, hide it to e.g. register them.
+    void chunks_changed() {}
+
+    /// For the derived destructors: flushes ignoring errors, but always waits for the writes
+    /// using the chunks.
+    void drain() noexcept
+    {
+        try {
+            flush();
+        } catch (...) {
+        }
+        for (size_t i{0}; i < m_chunks.size(); ++i) {
+            try {
+                wait_chunk(i);
+            } catch (...) {
+            }
+        }
+    }
+
+private:
+    void submit_current()
+    {
+        if (this->size() > 0) {
+            static_cast<Derived&>(*this).submit(m_current, this->data(), this->size(), m_flushed);
+            m_in_flight[m_current] = true;
+            m_flushed += this->size();
+            this->clear();
+            m_current = (m_current + 1) % m_chunks.size();
+        }
+    }
+
+    /// The chunk is free even if the wait throws.
+    void wait_chunk(const size_t index)
+    {
+        if (m_in_flight[index]) {
+            m_in_flight[index] = false;
+            static_cast<Derived&>(*this).wait(index);
+        }
+    }
+
+    size_t m_chunk_capacity;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    std::vector<bool> m_in_flight;
+    size_t m_current{0};
+    size_t m_flushed{0};
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
@@ -0,0 +1,219 @@
+#pragma once
+#ifndef SOCKET_HPP__W5FZ2NCJ
+#define SOCKET_HPP__W5FZ2NCJ
+
+// POSIX only, MSG_ZEROCOPY on Linux
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#define JSONWRITER_ZEROCOPY
+#endif
+
+#include <jsonwriter/sink.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+/// Streams the output to a connected socket in chunks, e.g. an HTTP response body, so a large
+/// response is never materialized. The chunks are sent by sendmsg(), the writev() of sockets,
+/// without SIGPIPE: a closed peer throws EPIPE instead.
+/// With zerocopy the chunks of at least ZEROCOPY_MIN bytes are sent by MSG_ZEROCOPY (Linux, TCP)
+/// and stay untouched until the kernel reports the completion, the serialization continues in
+/// the next chunk meanwhile. Smaller chunks are copied, pinning the pages doesn't pay off for
+/// them. If the socket doesn't support zerocopy, all chunks are copied. No other zerocopy
+/// sends may be done on the socket. The descriptor is not owned. Call flush() at the end, the
+/// destructor flushes too but ignores errors.
+class SocketBuffer : public AsyncSinkBuffer<SocketBuffer>
+{
+public:
+    static constexpr size_t ZEROCOPY_MIN{16 * 1024};
+
+    explicit SocketBuffer(const int fd, const size_t chunk_size = size_t{256} << 10,
+                          const bool zerocopy = false, const size_t chunk_count = 2)
+        : AsyncSinkBuffer{chunk_size, chunk_count}
+        , m_fd{fd}
+        , m_pending(this->chunk_count())
+    {
+#ifdef JSONWRITER_ZEROCOPY
+        const int one{1};
+        m_zerocopy = zerocopy
+                     && ::setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#else
+        static_cast<void>(zerocopy);
+#endif
+    }
+
+    ~SocketBuffer() override { drain(); }
+
+    /// Whether the large chunks are sent by MSG_ZEROCOPY.
+    bool zerocopy() const noexcept { return m_zerocopy; }
+
+    /// Number of chunks sent by MSG_ZEROCOPY.
+    size_t zerocopy_chunks() const noexcept { return m_zerocopy_chunks; }
+
+private:
+    friend class AsyncSinkBuffer<SocketBuffer>;
+
+    /// Zerocopy sends of a chunk to be completed.
+    struct Pending
+    {
+        bool active;
+        /// the count of the zerocopy sends including the last one of the chunk
+        uint32_t sends;
+    };
+
+    /// Throws std::system_error.
+    void submit(const size_t index, const char* const data, const size_t size, uint64_t)
+    {
+        m_pending[index].active = false;
+        if (!m_zerocopy || size < ZEROCOPY_MIN) {
+            send_all(data, size, 0);
+            return;
+        }
+        ++m_zerocopy_chunks;
+        const uint32_t sends_before{m_sends};
+        send_all(data, size, MSG_ZEROCOPY_FLAG);
+        if (m_sends != sends_before) {
+            m_pending[index] = Pending{true, m_sends};
+        }
+    }
+
+    /// Sends everything, a partial send continues with the rest. A zerocopy send the kernel
+    /// can't take (ENOBUFS over the optmem limit) falls back to copying.
+    void send_all(const char* data, size_t size, int flags)
+    {
+        while (size > 0) {
+            iovec iov{const_cast<char*>(data), std::min<size_t>(size, INT_MAX)};
+            msghdr message{};
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            const auto sent = ::sendmsg(m_fd, &message, flags | NOSIGNAL_FLAG);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == ENOBUFS && flags != 0) {
+                    flags = 0;
+                    continue;
+                }
+                throw std::system_error{errno, std::generic_category(), "sendmsg"};
+            }
+            if (flags != 0) {
+                ++m_sends;
+            }
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+    }
+
+    /// Reaps the completions until the zerocopy sends of the chunk are done.
+    /// Throws std::system_error.
+    void wait(const size_t index)
+    {
+        auto& pending = m_pending[index];
+        while (pending.active) {
+            if (static_cast<int32_t>(m_completed - pending.sends) >= 0) {
+                pending.active = false;
+                break;
+            }
+            reap();
+        }
+    }
+
+#ifdef JSONWRITER_ZEROCOPY
+    static constexpr int MSG_ZEROCOPY_FLAG{MSG_ZEROCOPY};
+
+    /// Blocks until a completion notification arrives on the error queue.
+    void reap()
+    {
+        bool signaled{false};
+        for (;;) {
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err)) + 64];
+            msghdr message{};
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            if (::recvmsg(m_fd, &message, MSG_ERRQUEUE) >= 0) {
+                for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr;
+                     header = CMSG_NXTHDR(&message, header)) {
+                    if (!((header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR)
+                          || (header->cmsg_level == SOL_IPV6
+                              && header->cmsg_type == IPV6_RECVERR))) {
+                        continue;
+                    }
+                    const auto* const error = reinterpret_cast<const sock_extended_err*>(
+                        CMSG_DATA(header));
+                    // ee_info..ee_data is the range of the completed sends, in order for TCP
+                    if (error->ee_errno == 0 && error->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                        m_completed = error->ee_data + 1;
+                    }
+                }
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                throw std::system_error{errno, std::generic_category(), "recvmsg"};
+            }
+            if (signaled) {
+                // not a completion but an error of the socket, e.g. a reset connection
+                throw std::system_error{socket_error(), std::generic_category(),
+                                        "zerocopy completion"};
+            }
+            // the error queue is signaled by POLLERR, which can't be masked
+            pollfd descriptor{m_fd, 0, 0};
+            if (::poll(&descriptor, 1, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error{errno, std::generic_category(), "poll"};
+            }
+            signaled = descriptor.revents != 0;
+        }
+    }
+
+    int socket_error() const noexcept
+    {
+        int error{0};
+        socklen_t length{sizeof(error)};
+        ::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        return error != 0 ? error : EPIPE;
+    }
+#else
+    static constexpr int MSG_ZEROCOPY_FLAG{0};
+
+    void reap() {}
+#endif
+
+#ifdef MSG_NOSIGNAL
+    static constexpr int NOSIGNAL_FLAG{MSG_NOSIGNAL};
+#else
+    static constexpr int NOSIGNAL_FLAG{0};
+#endif
+
+    int m_fd;
+    std::vector<Pending> m_pending;
+    bool m_zerocopy{false};
+    size_t m_zerocopy_chunks{0};
+    /// zerocopy sends so far, wraps around like the ids of the kernel
+    uint32_t m_sends{0};
+    /// the id of the last completed send + 1
+    uint32_t m_completed{0};
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
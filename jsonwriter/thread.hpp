@@ -0,0 +1,148 @@
+#pragma once
+#ifndef THREAD_HPP__K3VQ8ZRM
+#define THREAD_HPP__K3VQ8ZRM
+
+// POSIX only
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <sys/uio.h>
+
+#include <jsonwriter/fd.hpp>
+#include <jsonwriter/sink.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+/// Streams the output to a file descriptor from a dedicated thread, so the serialization and
+/// the writes overlap on two cores. A full chunk is handed off to the thread by an atomic state
+/// and the serialization continues in the next chunk. When the thread falls behind, i.e. all
+/// chunks are waiting, the producer blocks until the oldest one is written. The chunks are
+/// written in order. Either side sleeps only if it has nothing to do. The descriptor is not
+/// owned. Call flush() at the end, the destructor flushes too but ignores errors.
+/// After a write error the rest of the output is dropped and its submissions throw.
+class ThreadedFdBuffer : public AsyncSinkBuffer<ThreadedFdBuffer>
+{
+public:
+    /// Throws std::system_error if the thread can't be started.
+    explicit ThreadedFdBuffer(const int fd, const size_t chunk_size = size_t{1} << 20,
+                              const size_t chunk_count = 2)
+        : AsyncSinkBuffer{chunk_size, chunk_count}
+        , m_fd{fd}
+        , m_slots{new Slot[this->chunk_count()]}
+    {
+        m_thread = std::thread{[this] { run(); }};
+    }
+
+    ~ThreadedFdBuffer() override
+    {
+        drain();
+        m_stop.store(true);
+        wake();
+        m_thread.join();
+    }
+
+private:
+    friend class AsyncSinkBuffer<ThreadedFdBuffer>;
+
+    enum State : uint8_t
+    {
+        FREE,
+        FULL,
+    };
+
+    struct Slot
+    {
+        std::atomic<State> state{FREE};
+        const char* data{nullptr};
+        size_t size{0};
+    };
+
+    void submit(const size_t index, const char* const data, const size_t size, uint64_t)
+    {
+        auto& slot = m_slots[index];
+        slot.data = data;
+        slot.size = size;
+        slot.state.store(FULL);
+        wake();
+    }
+
+    /// Throws std::system_error if any write has failed.
+    void wait(const size_t index)
+    {
+        auto& slot = m_slots[index];
+        sleep_until([&slot] { return slot.state.load() == FREE; });
+        if (const int error{m_error.load(std::memory_order_relaxed)}; error != 0) {
+            throw std::system_error{error, std::generic_category(), "writev"};
+        }
+    }
+
+    void run()
+    {
+        for (size_t index{0};; index = (index + 1) % chunk_count()) {
+            auto& slot = m_slots[index];
+            sleep_until([this, &slot] { return slot.state.load() == FULL || m_stop.load(); });
+            if (slot.state.load() != FULL) {
+                // stopping, and the producer has waited for all chunks
+                return;
+            }
+            if (m_error.load(std::memory_order_relaxed) == 0) {
+                try {
+                    iovec iov{const_cast<char*>(slot.data), slot.size};
+                    detail::write_all(m_fd, &iov, 1);
+                } catch (const std::system_error& error) {
+                    m_error.store(error.code().value(), std::memory_order_relaxed);
+                }
+            }
+            slot.state.store(FREE);
+            wake();
+        }
+    }
+
+    /// Blocks until the condition holds. The condition changes only together with wake(), the
+    /// mutex is taken only when going to sleep or when the other side sleeps.
+    template<typename Condition>
+    void sleep_until(const Condition& condition)
+    {
+        if (condition()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_sleepers.fetch_add(1);
+        m_wakeup.wait(lock, condition);
+        m_sleepers.fetch_sub(1);
+    }
+
+    /// The sequentially consistent state change before the check pairs with the increment of
+    /// the sleepers before the check of the condition, one of the sides sees the other.
+    void wake()
+    {
+        if (m_sleepers.load() > 0) {
+            {
+                const std::lock_guard<std::mutex> lock{m_mutex};
+            }
+            m_wakeup.notify_all();
+        }
+    }
+
+    int m_fd;
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<bool> m_stop{false};
+    std::atomic<int> m_error{0};
+    std::atomic<int> m_sleepers{0};
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::thread m_thread;
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
@@ -0,0 +1,286 @@
+#pragma once
+#ifndef URING_HPP__H8DW3KPV
+#define URING_HPP__H8DW3KPV
+
+// Linux only, without liburing
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <jsonwriter/sink.hpp>
+
+namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
+
+namespace detail {
+
+/// Just enough of io_uring for the positional writes of UringFileBuffer.
+class IoUring : private NoCopyMove
+{
+public:
+    struct Completion
+    {
+        uint64_t user_data;
+        int32_t result;
+    };
+
+    /// Throws std::system_error, e.g. if io_uring is not supported or not permitted.
+    explicit IoUring(const unsigned entries)
+    {
+        io_uring_params params{};
+        const auto fd = ::syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0) {
+            throw std::system_error{errno, std::generic_category(), "io_uring_setup"};
+        }
+        m_fd = static_cast<int>(fd);
+
+        m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap{(params.features & IORING_FEAT_SINGLE_MMAP) != 0};
+        if (single_mmap) {
+            m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+        }
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+        m_sq_ring = map(m_sq_size, IORING_OFF_SQ_RING);
+        m_cq_ring = single_mmap ? m_sq_ring : map(m_cq_size, IORING_OFF_CQ_RING);
+        m_sqes = static_cast<io_uring_sqe*>(map(m_sqes_size, IORING_OFF_SQES));
+
+        auto* const sq = static_cast<char*>(m_sq_ring);
+        m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto* const cq = static_cast<char*>(m_cq_ring);
+        m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~IoUring() { release(); }
+
+    /// Registers the buffers for the fixed writes. Returns false if not possible, e.g. over the
+    /// locked memory limit.
+    bool register_buffers(const std::vector<iovec>& buffers) noexcept
+    {
+        unregister_buffers();
+        m_registered = ::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS,
+                                 buffers.data(), static_cast<unsigned>(buffers.size()))
+                       == 0;
+        return m_registered;
+    }
+
+    void unregister_buffers() noexcept
+    {
+        if (m_registered) {
+            ::syscall(__NR_io_uring_register, m_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            m_registered = false;
+        }
+    }
+
+    /// Submits a write at the offset, from the registered buffer buffer_index if registered.
+    /// The submission queue must not be full, i.e. no more writes in flight than the entries.
+    /// Throws std::system_error.
+    void write(const int fd, const char* const data, const unsigned size, const uint64_t offset,
+               const uint16_t buffer_index, const uint64_t user_data)
+    {
+        const unsigned tail{*m_sq_tail};
+        const unsigned index{tail & m_sq_mask};
+        io_uring_sqe& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = m_registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.off = offset;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = size;
+        sqe.buf_index = buffer_index;
+        sqe.user_data = user_data;
+        m_sq_array[index] = index;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        while (::syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR) {
+                throw std::system_error{errno, std::generic_category(), "io_uring_enter"};
+            }
+        }
+    }
+
+    /// Blocks until a write completes. Throws std::system_error.
+    Completion wait()
+    {
+        unsigned head{*m_cq_head};
+        while (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+            if (::syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                && errno != EINTR) {
+                throw std::system_error{errno, std::generic_category(), "io_uring_enter"};
+            }
+        }
+        const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+        const Completion completion{cqe.user_data, cqe.res};
+        __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+        return completion;
+    }
+
+private:
+    void* map(const size_t size, const uint64_t offset)
+    {
+        void* const ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 m_fd, static_cast<off_t>(offset));
+        if (ptr == MAP_FAILED) {
+            const auto error = errno;
+            release();
+            throw std::system_error{error, std::generic_category(), "mmap"};
+        }
+        return ptr;
+    }
+
+    void release() noexcept
+    {
+        if (m_sqes != nullptr) {
+            ::munmap(m_sqes, m_sqes_size);
+        }
+        if (m_cq_ring != nullptr && m_cq_ring != m_sq_ring) {
+            ::munmap(m_cq_ring, m_cq_size);
+        }
+        if (m_sq_ring != nullptr) {
+            ::munmap(m_sq_ring, m_sq_size);
+        }
+        ::close(m_fd);
+    }
+
+    int m_fd{-1};
+    bool m_registered{false};
+    size_t m_sq_size{0};
+    size_t m_cq_size{0};
+    size_t m_sqes_size{0};
+    void* m_sq_ring{nullptr};
+    void* m_cq_ring{nullptr};
+    io_uring_sqe* m_sqes{nullptr};
+    unsigned* m_sq_tail{nullptr};
+    unsigned m_sq_mask{0};
+    unsigned* m_sq_array{nullptr};
+    unsigned* m_cq_head{nullptr};
+    unsigned* m_cq_tail{nullptr};
+    unsigned m_cq_mask{0};
+    io_uring_cqe* m_cqes{nullptr};
+};
+
+} // namespace detail
+
+/// Streams the output to a file by io_uring. A full chunk is submitted and the serialization
+/// continues in the next one, it blocks only when all chunks are being written. The chunks are
+/// registered in the ring if the locked memory limit allows it. The writes are positional,
+/// starting at the current file position which is not moved. The descriptor is not owned.
+/// Call flush() at the end, the destructor flushes too but ignores errors.
+class UringFileBuffer : public AsyncSinkBuffer<UringFileBuffer>
+{
+public:
+    /// Throws std::system_error, e.g. if io_uring is not available.
+    explicit UringFileBuffer(const int fd, const size_t chunk_size = size_t{1} << 20,
+                             const size_t chunk_count = 4)
+        : AsyncSinkBuffer{chunk_size, chunk_count}
+        , m_fd{fd}
+        , m_ring{static_cast<unsigned>(this->chunk_count())}
+        , m_pending(this->chunk_count())
+    {
+        const auto position = ::lseek(m_fd, 0, SEEK_CUR);
+        m_start = position > 0 ? static_cast<uint64_t>(position) : 0;
+        chunks_changed();
+    }
+
+    ~UringFileBuffer() override { drain(); }
+
+    /// Whether the chunks are registered in the ring.
+    bool registered() const noexcept { return m_registered; }
+
+private:
+    friend class AsyncSinkBuffer<UringFileBuffer>;
+
+    /// The part of a chunk being written.
+    struct Pending
+    {
+        const char* data;
+        size_t size;
+        uint64_t offset;
+        bool done;
+    };
+
+    void chunks_changed()
+    {
+        std::vector<iovec> chunks(chunk_count());
+        for (size_t i{0}; i < chunks.size(); ++i) {
+            chunks[i] = iovec{chunk(i), chunk_capacity()};
+        }
+        m_registered = m_ring.register_buffers(chunks);
+    }
+
+    void submit(const size_t index, const char* const data, const size_t size,
+                const uint64_t offset)
+    {
+        m_pending[index] = Pending{data, size, m_start + offset, false};
+        submit_pending(index);
+    }
+
+    void submit_pending(const size_t index)
+    {
+        const auto& pending = m_pending[index];
+        // a single write is limited to 2 GB anyway
+        const auto size = static_cast<unsigned>(std::min<size_t>(pending.size, 1u << 30));
+        m_ring.write(m_fd, pending.data, size, pending.offset, static_cast<uint16_t>(index),
+                     index);
+    }
+
+    /// Reaps the completions until the chunk is written. The first error of any chunk is thrown
+    /// once the chunk is complete.
+    void wait(const size_t index)
+    {
+        while (!m_pending[index].done) {
+            const auto completion = m_ring.wait();
+            auto& pending = m_pending[completion.user_data];
+            if (completion.result <= 0) {
+                pending.done = true;
+                if (m_error == 0) {
+                    m_error = completion.result < 0 ? -completion.result : EIO;
+                }
+                continue;
+            }
+            const auto written = static_cast<size_t>(completion.result);
+            pending.data += written;
+            pending.size -= written;
+            pending.offset += written;
+            if (pending.size > 0) {
+                submit_pending(completion.user_data);
+            } else {
+                pending.done = true;
+            }
+        }
+        if (m_error != 0) {
+            throw std::system_error{std::exchange(m_error, 0), std::generic_category(),
+                                    "io_uring write"};
+        }
+    }
+
+    int m_fd;
+    detail::IoUring m_ring;
+    std::vector<Pending> m_pending;
+    uint64_t m_start{0};
+    bool m_registered{false};
+    int m_error{0};
+};
+
+} // inline namespace JSONWRITER_ABI
+} // namespace jsonwriter
+
+#endif /* include guard */
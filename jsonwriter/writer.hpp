@@ -5,14 +5,20 @@
 #include <algorithm>
 #include <any>
 #include <array>
+#include <cstdlib>
 #include <cstring>
 #include <deque>
 #include <forward_list>
 #include <functional>
 #include <initializer_list>
+#include <limits>
 #include <list>
 #include <memory>
+#include <new>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -34,7 +40,11 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <jsonwriter/config.hpp>
+#include <jsonwriter/float16.hpp>
+
 namespace jsonwriter {
+inline namespace JSONWRITER_ABI {
 
 namespace detail {
 
@@ -52,9 +62,43 @@ private:
 
 } // namespace detail
 
+class Cursor;
+class ListProxy;
+class ObjectProxy;
+
+namespace detail {
+class SeparatorScope;
+} // namespace detail
+
+/// Growth statistics of a buffer, see JSONWRITER_INSTRUMENTATION.
+struct BufferStats
+{
+    /// realloc() calls
+    size_t reallocs{0};
+    /// data copied by realloc(), not counting the moves without a copy, e.g. by mremap()
+    size_t bytes_copied{0};
+    size_t peak_capacity{0};
+    /// reserve() and make_room() calls
+    size_t reservations{0};
+    /// reserved room which was not written before the next reservation
+    size_t reservation_waste{0};
+};
+
+/// Thrown by Buffer::rollback() to a checkpoint before the data in memory.
+class RollbackError : public std::runtime_error
+{
+public:
+    RollbackError()
+        : std::runtime_error{"rollback past the data passed on"}
+    {
+    }
+};
+
 /// Optimized buffer for serialization. Writing to the reserved space is valid
 /// if consume() is called afterwards before calling make_room() or reserve().
 /// The buffer is not copyable to avoid unwanted copies.
+/// Space reserved in front of the data (headroom) allows prepending e.g. protocol headers
+/// once the data is known, without moving the data.
 class Buffer
 {
 public:
@@ -67,32 +111,41 @@ public:
     Buffer(Buffer&& other) = default;
     Buffer& operator=(Buffer&& other) = default;
 
-    char* begin() noexcept { return m_ptr; }
+    char* begin() noexcept { return m_ptr + m_headroom; }
     char* end() noexcept { return m_working_end; }
     const char* data() const noexcept { return begin(); }
     const char* end() const noexcept { return m_working_end; }
 
     char* data() noexcept { return begin(); }
-    const char* begin() const noexcept { return m_ptr; }
+    const char* begin() const noexcept { return m_ptr + m_headroom; }
 
     // Use this pointer for appending data to the reserved space.
     char* working_end() noexcept { return m_working_end; }
 
     size_t size() const noexcept { return static_cast<size_t>(end() - begin()); }
-    size_t capacity() const noexcept { return m_capacity; }
-    size_t room() const noexcept { return m_capacity - size(); }
+    size_t capacity() const noexcept { return m_capacity - m_headroom; }
+    size_t room() const noexcept { return capacity() - size(); }
 
     void reserve(const size_t count)
     {
         assert(m_ptr != nullptr);
-        if (count > m_capacity) {
-            realloc(size(), count);
+        record_reservation(count);
+        if (count > capacity()) {
+            realloc(m_headroom + size(), m_headroom + count);
+            record_realloc();
         }
         assert(size() + room() == capacity());
     }
 
-    /// Keep the allocated space but discard all data.
-    void clear() noexcept { m_working_end = begin(); }
+    /// Keep the allocated space but discard all data and the headroom. The derived buffers
+    /// reset their own state in on_clear().
+    void clear() noexcept
+    {
+        const auto used = m_headroom + size();
+        m_headroom = 0;
+        m_working_end = m_ptr;
+        on_clear(used);
+    }
 
     /// Make room for at least "count" characters.
     void make_room(const size_t count) { reserve(size() + count); }
@@ -107,7 +160,7 @@ public:
     void consume(char* const new_working_end) noexcept
     {
         assert(new_working_end >= m_working_end);
-        assert(new_working_end <= begin() + m_capacity);
+        assert(new_working_end <= m_ptr + m_capacity);
         m_working_end = new_working_end;
     }
 
@@ -135,45 +188,456 @@ public:
         consume(std::copy_n(c, N - 1, m_working_end));
     }
 
+    /// Makes room for at least "count" characters and returns a cursor for writing them
+    /// without capacity checks.
+    Cursor reserve_cursor(size_t count);
+
+    /// Reserves "count" characters in front of the data. Only for an empty buffer.
+    /// The headroom is kept on growth but not by clear() and by the buffers which flush
+    /// (sinks, segments of ChainBuffer).
+    void reserve_headroom(const size_t count)
+    {
+        assert(size() == 0);
+        make_room(count);
+        m_headroom += count;
+        m_working_end = begin();
+    }
+
+    /// Space left in front of the data.
+    size_t headroom() const noexcept { return m_headroom; }
+
+    /// Moves the data beginning back by "count" characters of the headroom and returns the new
+    /// beginning, write the prepended characters there.
+    char* push_front(const size_t count) noexcept
+    {
+        assert(count <= m_headroom);
+        m_headroom -= count;
+        return begin();
+    }
+
+    /// Prepends the characters into the headroom.
+    void prepend(const std::string_view chars) noexcept
+    {
+        std::copy_n(chars.data(), chars.size(), push_front(chars.size()));
+    }
+
+    /// State to return to by rollback().
+    struct Checkpoint
+    {
+        /// position in the whole output, including the data passed on, e.g. flushed
+        size_t offset;
+        /// separator state of the innermost open ObjectProxy/ListProxy
+        bool* first;
+        bool first_value;
+    };
+
+    /// Marks the current state for dropping speculatively written data, e.g. an object
+    /// member which turns out to be filtered out.
+    Checkpoint checkpoint() const noexcept
+    {
+        return {passed_on() + size(), m_first, m_first != nullptr && *m_first};
+    }
+
+    /// Discards the data written since the checkpoint and restores the separator state of the
+    /// enclosing ObjectProxy/ListProxy. Only in the same proxy scope as checkpoint().
+    /// Throws RollbackError if a part of the data is not in memory anymore, e.g. flushed, the
+    /// buffer is unchanged then.
+    void rollback(const Checkpoint& checkpoint)
+    {
+        assert(checkpoint.first == m_first);
+        rewind(checkpoint.offset);
+        if (m_first != nullptr) {
+            *m_first = checkpoint.first_value;
+        }
+    }
+
+    /// Collected only with JSONWRITER_INSTRUMENTATION, otherwise all zeros.
+    BufferStats stats() const noexcept
+    {
+#if JSONWRITER_INSTRUMENTATION
+        auto stats = m_stats;
+        // the last reservation
+        if (size() >= m_reservation_start && size() - m_reservation_start < m_reserved) {
+            stats.reservation_waste += m_reserved - (size() - m_reservation_start);
+        }
+        return stats;
+#else
+        return {};
+#endif
+    }
+
+    void reset_stats() noexcept
+    {
+#if JSONWRITER_INSTRUMENTATION
+        m_stats = BufferStats{};
+        m_stats.peak_capacity = m_capacity;
+        m_reserved = 0;
+#endif
+    }
+
     /// Put anything you need in here.
     std::any context{};
 
 protected:
     /// Implement in derived class. It is called only if the current capacity
-    /// is exhausted.
+    /// is exhausted. The sizes include the headroom, i.e. they are counted from the pointer
+    /// given to set_data().
     virtual void realloc(size_t data_size, size_t new_capacity) = 0;
 
+    /// Called by clear() after discarding the data, `used` is the discarded size including the
+    /// headroom. Override to reset the state of the derived buffer, not clear() which is called
+    /// through Buffer& too.
+    virtual void on_clear(size_t /*used*/) noexcept {}
+
+    /// Size of the output passed on before the data, e.g. flushed or sealed. Override together
+    /// with rewind().
+    virtual size_t passed_on() const noexcept { return 0; }
+
+    /// Called by rollback() to drop the output from the offset on, see Checkpoint::offset.
+    /// Throws RollbackError if the offset is before the data.
+    virtual void rewind(const size_t offset)
+    {
+        const size_t start{passed_on()};
+        assert(offset <= start + size());
+        if (offset < start) {
+            throw RollbackError{};
+        }
+        m_working_end = begin() + (offset - start);
+    }
+
     /// Must be called by the derived class on every data pointer change:
     /// * construction
     /// * move construction/assignment
     /// * realloc
+    /// The sizes include the headroom. The headroom is kept as far as the size covers it.
     void set_data(char* ptr, size_t size, size_t capacity)
+    {
+        set_data(ptr, size, capacity, std::min(m_headroom, size));
+    }
+
+    /// The same with a new headroom, e.g. on move construction.
+    void set_data(char* ptr, size_t size, size_t capacity, size_t headroom)
     {
         assert(capacity >= m_capacity);
+        assert(headroom <= size);
 
         m_ptr = ptr;
         m_working_end = ptr + size;
         m_capacity = capacity;
+        m_headroom = headroom;
+#if JSONWRITER_INSTRUMENTATION
+        m_stats.peak_capacity = std::max(m_stats.peak_capacity, capacity);
+#endif
+    }
+
+    /// Instrumentation hooks of the growth paths, no-op without JSONWRITER_INSTRUMENTATION.
+    void record_reservation([[maybe_unused]] const size_t count) noexcept
+    {
+#if JSONWRITER_INSTRUMENTATION
+        const auto data_size = size();
+        if (data_size >= m_reservation_start && data_size - m_reservation_start < m_reserved) {
+            m_stats.reservation_waste += m_reserved - (data_size - m_reservation_start);
+        }
+        ++m_stats.reservations;
+        m_reservation_start = data_size;
+        m_reserved = count > data_size ? count - data_size : 0;
+#endif
+    }
+
+    void record_realloc() noexcept
+    {
+#if JSONWRITER_INSTRUMENTATION
+        ++m_stats.reallocs;
+#endif
+    }
+
+    /// For the realloc() implementations copying the data, a moved pointer alone isn't a copy,
+    /// e.g. a segment switch or mremap().
+    void record_copy([[maybe_unused]] const size_t bytes) noexcept
+    {
+#if JSONWRITER_INSTRUMENTATION
+        m_stats.bytes_copied += bytes;
+#endif
+    }
+
+    /// set_data() for a deliberate switch to a smaller storage.
+    void reset_data(char* ptr, size_t size, size_t capacity)
+    {
+        m_capacity = 0;
+        set_data(ptr, size, capacity);
+    }
+
+    void reset_data(char* ptr, size_t size, size_t capacity, size_t headroom)
+    {
+        m_capacity = 0;
+        set_data(ptr, size, capacity, headroom);
     }
 
 private:
+    friend class detail::SeparatorScope;
+
     char* m_ptr{nullptr};
     char* m_working_end{nullptr};
     size_t m_capacity{0};
+    size_t m_headroom{0};
+    /// separator state of the innermost open ObjectProxy/ListProxy
+    bool* m_first{nullptr};
+#if JSONWRITER_INSTRUMENTATION
+    BufferStats m_stats{};
+    /// the last reservation
+    size_t m_reservation_start{0};
+    size_t m_reserved{0};
+#endif
+};
+
+/// Unchecked writing into the room reserved by Buffer::reserve_cursor(). The write position is
+/// a local copy which the compiler can keep in a register, the buffer is updated only by
+/// commit() or at the end of the cursor scope. Nothing must touch the buffer directly meanwhile.
+/// The cursor has the buffer writing interface so it can be passed to jsonwriter::write() and
+/// to the formatters. Capacity is only asserted, the reservation must cover the whole output.
+/// Formatters and write() members taking Buffer& are run on the underlying buffer.
+class Cursor : private detail::NoCopyMove
+{
+public:
+    explicit Cursor(Buffer& buffer) noexcept
+        : context{buffer.context}
+        , m_buffer{buffer}
+        , m_working_end{buffer.working_end()}
+        , m_end{m_working_end + buffer.room()}
+    {
+    }
+
+    ~Cursor() { commit(); }
+
+    char* working_end() noexcept { return m_working_end; }
+    size_t room() const noexcept { return static_cast<size_t>(m_end - m_working_end); }
+
+    /// Checks the reservation only.
+    void make_room([[maybe_unused]] const size_t count) noexcept { assert(room() >= count); }
+
+    void consume(const size_t diff) noexcept
+    {
+        assert(room() >= diff);
+        m_working_end += diff;
+    }
+
+    void consume(char* const new_working_end) noexcept
+    {
+        assert(new_working_end >= m_working_end);
+        assert(new_working_end <= m_end);
+        m_working_end = new_working_end;
+    }
+
+    void append_no_grow(const char c) noexcept
+    {
+        *m_working_end = c;
+        consume(1);
+    }
+
+    void append(const char c) noexcept { append_no_grow(c); }
+
+    template<size_t N>
+    void append(const char (&c)[N]) noexcept
+    {
+        make_room(N - 1);
+        consume(std::copy_n(c, N - 1, m_working_end));
+    }
+
+    /// Publishes the written data to the buffer.
+    void commit() noexcept { m_buffer.consume(m_working_end); }
+
+    /// Commits, runs `callback(Buffer&)` on the underlying buffer and reserves the remaining
+    /// room again.
+    template<typename Callback>
+    void with_buffer(Callback&& callback)
+    {
+        const size_t remaining = room();
+        commit();
+        callback(m_buffer);
+        m_buffer.make_room(remaining);
+        m_working_end = m_buffer.working_end();
+        m_end = m_working_end + remaining;
+    }
+
+    std::any& context;
+
+private:
+    Buffer& m_buffer;
+    char* m_working_end;
+    char* m_end;
+};
+
+inline Cursor Buffer::reserve_cursor(const size_t count)
+{
+    make_room(count);
+    return Cursor{*this};
+}
+
+/// Base of the concrete buffers. The growing members hide the Buffer ones, so the capacity check
+/// is inlined when jsonwriter::write() gets the concrete buffer type. Buffer& keeps working as
+/// the type-erased fallback. The cold grow path calls realloc() virtually, so the classes derived
+/// from a concrete buffer keep their override.
+template<typename Derived>
+class BufferImpl : public Buffer
+{
+public:
+    void reserve(const size_t count)
+    {
+        assert(begin() != nullptr);
+        record_reservation(count);
+        if (count > capacity()) {
+            grow(headroom() + count);
+        }
+        assert(size() + room() == capacity());
+    }
+
+    void make_room(const size_t count) { reserve(size() + count); }
+
+    void append(const char c)
+    {
+        make_room(1);
+        append_no_grow(c);
+    }
+
+    template<size_t N>
+    void append(const char (&c)[N])
+    {
+        make_room(N - 1);
+        consume(std::copy_n(c, N - 1, working_end()));
+    }
+
+    Cursor reserve_cursor(const size_t count)
+    {
+        make_room(count);
+        return Cursor{*this};
+    }
+
+private:
+    /// Keep the rare path out of the inlined code.
+#ifndef _MSC_VER
+    __attribute__((noinline, cold))
+#endif
+    void grow(const size_t new_capacity)
+    {
+        this->realloc(headroom() + size(), new_capacity);
+        record_realloc();
+    }
+};
+
+/// Growth policies of SimpleBuffer: `static size_t next_capacity(capacity, required)` returns
+/// the new capacity, at least `required`.
+
+/// Multiplies the capacity by NUMERATOR / DENOMINATOR.
+template<size_t NUMERATOR = 3, size_t DENOMINATOR = 2>
+struct GrowthFactor
+{
+    static_assert(NUMERATOR > DENOMINATOR);
+
+    static size_t next_capacity(const size_t capacity, const size_t required)
+    {
+        return std::max(required, capacity / DENOMINATOR * NUMERATOR
+                                      + capacity % DENOMINATOR * NUMERATOR / DENOMINATOR);
+    }
+};
+
+/// Rounds up to the size classes of the common allocators (jemalloc, tcmalloc), 4 per doubling.
+/// The allocator would waste the difference anyway.
+template<typename Growth = GrowthFactor<>>
+struct GrowthSizeClasses
+{
+    static size_t next_capacity(const size_t capacity, const size_t required)
+    {
+        const size_t size{Growth::next_capacity(capacity, required)};
+        // the largest power of 2 below the size
+        size_t power{16};
+        while (power * 2 < size) {
+            power *= 2;
+        }
+        const size_t spacing{std::max(power / 4, size_t{16})};
+        return (size + spacing - 1) / spacing * spacing;
+    }
+};
+
+/// Rounds the large capacities up to 2 MB huge pages, the smaller ones to the size classes.
+template<typename Growth = GrowthFactor<>>
+struct GrowthHugePages
+{
+    static constexpr size_t HUGE_PAGE_SIZE{size_t{2} << 20};
+
+    static size_t next_capacity(const size_t capacity, const size_t required)
+    {
+        const size_t size{Growth::next_capacity(capacity, required)};
+        if (size < HUGE_PAGE_SIZE) {
+            return GrowthSizeClasses<Growth>::next_capacity(capacity, required);
+        }
+        return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+};
+
+/// Shrink policies of SimpleBuffer: `size_t on_clear(used, capacity)` is called by
+/// SimpleBuffer::clear() with the size of the discarded data and returns the capacity to shrink
+/// to, 0 to keep the capacity. Clearing an empty buffer doesn't end a document and isn't passed
+/// on.
+
+/// Keeps the peak capacity.
+struct NoShrink
+{
+    static constexpr size_t on_clear(size_t, size_t) noexcept { return 0; }
+};
+
+/// Shrinks to the largest of the last COUNT documents if all of them used less than 1/RATIO of
+/// the capacity. A larger COUNT means less reallocations of the buffers which get a large
+/// document once in a while, a smaller one less memory held by idle buffers.
+template<size_t COUNT = 16, size_t RATIO = 4>
+class ShrinkAfter
+{
+public:
+    static_assert(COUNT > 0 && RATIO > 1);
+
+    size_t on_clear(const size_t used, const size_t capacity) noexcept
+    {
+        if (used >= capacity / RATIO) {
+            m_small = 0;
+            m_largest = 0;
+            return 0;
+        }
+        m_largest = std::max(m_largest, used);
+        if (++m_small < COUNT) {
+            return 0;
+        }
+        m_small = 0;
+        return std::exchange(m_largest, 0);
+    }
+
+private:
+    /// consecutive small documents
+    size_t m_small{0};
+    size_t m_largest{0};
 };
 
 /// Simple growing buffer with a fixed initial capacity.
 /// Moved-from instance behavior is undefined.
-template<size_t INITIAL_FIXED_CAPACITY = 1024>
-class SimpleBuffer : public Buffer
+template<size_t INITIAL_FIXED_CAPACITY = 1024, typename GrowthPolicy = GrowthFactor<>,
+         typename ShrinkPolicy = NoShrink>
+class SimpleBuffer
+    : public BufferImpl<SimpleBuffer<INITIAL_FIXED_CAPACITY, GrowthPolicy, ShrinkPolicy>>
+    , private ShrinkPolicy
 {
 public:
-    explicit SimpleBuffer() { set_data(m_ptr, 0, m_capacity); }
+    explicit SimpleBuffer() { this->set_data(m_ptr, 0, m_capacity); }
 
-    SimpleBuffer(SimpleBuffer&& other) { move_from(std::move(other)); }
-    SimpleBuffer& operator=(SimpleBuffer&& other)
+    SimpleBuffer(SimpleBuffer&& other) noexcept
+        : ShrinkPolicy{static_cast<ShrinkPolicy&&>(other)}
     {
         move_from(std::move(other));
+    }
+
+    SimpleBuffer& operator=(SimpleBuffer&& other) noexcept
+    {
+        if (&other != this) {
+            ShrinkPolicy::operator=(static_cast<ShrinkPolicy&&>(other));
+            move_from(std::move(other));
+        }
         return *this;
     }
 
@@ -187,51 +651,430 @@ public:
             return;
         }
 
-        const auto bulk_new_capacity = std::max(new_capacity, m_capacity + m_capacity / 2);
+        const auto bulk_new_capacity = GrowthPolicy::next_capacity(m_capacity, new_capacity);
+        assert(bulk_new_capacity >= new_capacity);
         auto new_dynamic = Dynamic{new char[bulk_new_capacity]};
         assert(m_ptr != nullptr);
         ::memcpy(new_dynamic.get(), m_ptr, data_size);
+        this->record_copy(data_size);
 
         m_dynamic = std::move(new_dynamic);
         m_ptr = m_dynamic.get();
         m_capacity = bulk_new_capacity;
 
-        set_data(m_ptr, data_size, m_capacity);
+        this->set_data(m_ptr, data_size, m_capacity);
+    }
+
+    /// Frees the capacity not needed by the data, back to the static buffer if the data fits.
+    void shrink_to_fit() noexcept { shrink(0); }
+
+protected:
+    /// The ShrinkPolicy may shrink the capacity.
+    void on_clear(const size_t used) noexcept override
+    {
+        if (used == 0) {
+            return;
+        }
+        const auto capacity = ShrinkPolicy::on_clear(used, m_capacity);
+        if (capacity > 0) {
+            shrink(capacity);
+        }
+    }
+
+private:
+    /// Shrinks to the given capacity or the data size, whichever is larger.
+    void shrink(const size_t capacity) noexcept
+    {
+        const auto data_size = this->headroom() + this->size();
+        const auto new_capacity = std::max(capacity, data_size);
+        if (m_ptr == m_static.data() || new_capacity >= m_capacity) {
+            return;
+        }
+
+        if (new_capacity <= INITIAL_FIXED_CAPACITY) {
+            ::memcpy(m_static.data(), m_ptr, data_size);
+            m_dynamic.reset();
+            m_ptr = m_static.data();
+            m_capacity = m_static.size();
+        } else {
+            // nothrow, keep the capacity if out of memory
+            auto new_dynamic = Dynamic{new (std::nothrow) char[new_capacity]};
+            if (!new_dynamic) {
+                return;
+            }
+            ::memcpy(new_dynamic.get(), m_ptr, data_size);
+            m_dynamic = std::move(new_dynamic);
+            m_ptr = m_dynamic.get();
+            m_capacity = new_capacity;
+        }
+        this->reset_data(m_ptr, data_size, m_capacity);
+    }
+
+    /// Copies only the used part of the static buffer. The own dynamic storage is released if
+    /// the data goes to the static buffer, the capacity may shrink.
+    void move_from(SimpleBuffer&& other) noexcept
+    {
+        const auto headroom = other.headroom();
+        const auto old_size = headroom + other.size();
+
+        if (other.m_ptr == other.m_static.data()) {
+            ::memcpy(m_static.data(), other.m_static.data(), old_size);
+            m_dynamic.reset();
+            m_ptr = m_static.data();
+            m_capacity = m_static.size();
+        } else {
+            m_dynamic = std::move(other.m_dynamic);
+            m_ptr = m_dynamic.get();
+            m_capacity = other.m_capacity;
+            other.m_ptr = other.m_static.data();
+            other.m_capacity = other.m_static.size();
+        }
+
+        this->context = std::move(other.context);
+        this->reset_data(m_ptr, old_size, m_capacity, headroom);
+        other.clear();
+        other.set_data(nullptr, 0, other.capacity());
+    }
+
+    using Dynamic = std::unique_ptr<char[]>;
+
+    std::array<char, INITIAL_FIXED_CAPACITY> m_static;
+    Dynamic m_dynamic{};
+    char* m_ptr{m_static.data()};
+    size_t m_capacity{m_static.size()};
+};
+
+namespace detail {
+
+/// Larger bounded values are written with the capacity checks rather than reserving a lot of
+/// memory which is mostly not used. It is the largest reservation of the built-in formatters.
+static constexpr size_t MAX_CURSOR_RESERVATION{4096};
+
+} // namespace detail
+
+/// Buffer which never allocates, e.g. for real-time threads. If the data doesn't fit in
+/// CAPACITY, the buffer is marked as overflowed and the rest of the output is discarded into a
+/// scratch space of OVERFLOW_ROOM bytes. It holds any single reservation of the built-in
+/// formatters, custom formatters must not reserve more than OVERFLOW_ROOM at once. The writing
+/// hot path is the same as of the other buffers, check overflowed() once at the end. mark() the
+/// ends of complete values for complete_view().
+template<size_t CAPACITY, size_t OVERFLOW_ROOM = detail::MAX_CURSOR_RESERVATION>
+class FixedBuffer : public BufferImpl<FixedBuffer<CAPACITY, OVERFLOW_ROOM>>
+{
+    static_assert(OVERFLOW_ROOM >= detail::MAX_CURSOR_RESERVATION,
+                  "the overflow room must hold the largest reservation of the formatters");
+
+public:
+    explicit FixedBuffer() { this->set_data(m_storage.data(), 0, m_storage.size()); }
+
+    FixedBuffer(const FixedBuffer&) = delete;
+    FixedBuffer& operator=(const FixedBuffer&) = delete;
+    FixedBuffer(FixedBuffer&&) = delete;
+    FixedBuffer& operator=(FixedBuffer&&) = delete;
+
+    bool overflowed() const noexcept
+    {
+        return m_overflowed || this->headroom() + this->size() > CAPACITY;
+    }
+
+    /// The data which fit, the last value may be incomplete if overflowed.
+    std::string_view view() const noexcept
+    {
+        return {this->data(), std::min(this->size(), CAPACITY - this->headroom())};
+    }
+
+    /// Marks the end of a complete value, e.g. of a list item.
+    void mark() noexcept
+    {
+        if (!overflowed()) {
+            m_mark = this->headroom() + this->size();
+        }
+    }
+
+    /// All data if not overflowed, otherwise truncated to the last mark().
+    std::string_view complete_view() const noexcept
+    {
+        if (!overflowed()) {
+            return view();
+        }
+        const auto headroom = this->headroom();
+        return {this->data(), m_mark > headroom ? m_mark - headroom : 0};
+    }
+
+    /// Never allocates, it only rewinds to the beginning of the scratch space.
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        m_overflowed = true;
+        if (new_capacity - data_size > OVERFLOW_ROOM) {
+            // a custom reservation larger than the scratch space, the output can't be discarded
+            assert(false);
+            std::abort();
+        }
+        m_discarded += data_size - CAPACITY;
+        this->set_data(m_storage.data(), CAPACITY, m_storage.size());
+    }
+
+protected:
+    void on_clear(size_t) noexcept override
+    {
+        m_overflowed = false;
+        m_mark = 0;
+        m_discarded = 0;
+    }
+
+    size_t passed_on() const noexcept override { return m_discarded; }
+
+    /// The data up to the capacity is never overwritten, a checkpoint within it undoes the
+    /// overflow. The discarded output is dropped anyway.
+    void rewind(const size_t offset) override
+    {
+        const auto headroom = this->headroom();
+        if (headroom + offset <= CAPACITY) {
+            m_overflowed = false;
+            m_discarded = 0;
+            m_mark = std::min(m_mark, headroom + offset);
+            Buffer::rewind(offset);
+        } else {
+            Buffer::rewind(std::max(offset, m_discarded + CAPACITY - headroom));
+        }
+    }
+
+private:
+    std::array<char, CAPACITY + OVERFLOW_ROOM> m_storage;
+    bool m_overflowed{false};
+    size_t m_mark{0};
+    /// output rewound over in the scratch space
+    size_t m_discarded{0};
+};
+
+/// Allocator leaving new elements uninitialized on resize(). std::vector<char> zeroes the growth
+/// of a VectorBuffer, with `std::vector<char, DefaultInitAllocator<char>>` it doesn't.
+template<typename T>
+struct DefaultInitAllocator : std::allocator<T>
+{
+    template<typename U>
+    struct rebind
+    {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    DefaultInitAllocator() = default;
+
+    template<typename U>
+    DefaultInitAllocator(const DefaultInitAllocator<U>&) noexcept
+    {
+    }
+
+    template<typename U>
+    void construct(U* const ptr) noexcept(std::is_nothrow_default_constructible_v<U>)
+    {
+        ::new (static_cast<void*>(ptr)) U;
+    }
+
+    template<typename U, typename... Args>
+    void construct(U* const ptr, Args&&... args)
+    {
+        ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+};
+
+/// Writes directly into a user's container of chars, e.g. std::string or std::vector<char>,
+/// appending to its content. The container is resized on growth and trimmed to the written
+/// size by finish() or the destructor. It must not be touched meanwhile. Not movable.
+/// std::string is not initialized on growth with C++23 resize_and_overwrite(), a vector only
+/// with DefaultInitAllocator.
+template<typename Container>
+class ContainerBuffer : public BufferImpl<ContainerBuffer<Container>>
+{
+public:
+    explicit ContainerBuffer(Container& target, const size_t initial_capacity = 256)
+        : m_target{target}
+    {
+        const auto data_size = m_target.size();
+        resize(std::max(data_size + initial_capacity, m_target.capacity()));
+        this->set_data(m_target.data(), data_size, m_target.size());
+    }
+
+    ContainerBuffer(const ContainerBuffer&) = delete;
+    ContainerBuffer& operator=(const ContainerBuffer&) = delete;
+    ContainerBuffer(ContainerBuffer&&) = delete;
+    ContainerBuffer& operator=(ContainerBuffer&&) = delete;
+
+    ~ContainerBuffer() override { finish(); }
+
+    /// Trims the container to the written size. The buffer is not usable afterwards.
+    Container& finish()
+    {
+        if (!m_finished) {
+            m_finished = true;
+            const auto headroom = this->headroom();
+            m_target.resize(headroom + this->size());
+            // the unused headroom
+            m_target.erase(m_target.begin(), m_target.begin() + static_cast<ptrdiff_t>(headroom));
+        }
+        return m_target;
+    }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        assert(!m_finished);
+        const auto capacity = m_target.size();
+        const auto* const old_data = m_target.data();
+        resize(std::max(new_capacity, capacity + capacity / 2));
+        if (m_target.data() != old_data) {
+            // the whole container
+            this->record_copy(capacity);
+        }
+        this->set_data(m_target.data(), data_size, m_target.size());
+    }
+
+private:
+    /// Without initializing the new characters if possible.
+    void resize(const size_t size)
+    {
+#ifdef __cpp_lib_string_resize_and_overwrite
+        if constexpr (std::is_same_v<Container, std::string>) {
+            m_target.resize_and_overwrite(size, [](char*, const size_t count) { return count; });
+            return;
+        }
+#endif
+        m_target.resize(size);
+    }
+
+    Container& m_target;
+    bool m_finished{false};
+};
+
+using StringBuffer = ContainerBuffer<std::string>;
+using VectorBuffer = ContainerBuffer<std::vector<char>>;
+using DefaultInitVectorBuffer = ContainerBuffer<std::vector<char, DefaultInitAllocator<char>>>;
+
+/// Dry run, it counts the output size without storing the output, see serialized_size().
+/// The output goes to a small scratch space which is reused. The formatters which know their
+/// output size (e.g. strings) only add() it.
+class CountingBuffer : public BufferImpl<CountingBuffer>
+{
+public:
+    explicit CountingBuffer() { set_data(m_scratch.data(), 0, m_scratch.size()); }
+
+    CountingBuffer(const CountingBuffer&) = delete;
+    CountingBuffer& operator=(const CountingBuffer&) = delete;
+    CountingBuffer(CountingBuffer&&) = delete;
+    CountingBuffer& operator=(CountingBuffer&&) = delete;
+
+    /// Number of characters written so far.
+    size_t count() const noexcept { return m_count + size(); }
+
+    /// Counts characters without writing them.
+    void add(const size_t count) noexcept { m_count += count; }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        if (new_capacity - data_size > m_scratch.size()) {
+            // larger than any reservation of the built-in formatters
+            assert(false);
+            std::abort();
+        }
+        m_count += data_size;
+        set_data(m_scratch.data(), 0, m_scratch.size());
+    }
+
+protected:
+    size_t passed_on() const noexcept override { return m_count; }
+
+    /// Only the count matters, any checkpoint can be returned to.
+    void rewind(const size_t offset) override
+    {
+        m_count = std::min(m_count, offset);
+        Buffer::rewind(offset);
+    }
+
+private:
+    std::array<char, detail::MAX_CURSOR_RESERVATION> m_scratch;
+    size_t m_count{0};
+};
+
+/// Writes into a caller's storage of the output size (see write_exact()) without a copy. The
+/// formatters reserve more room than they use, the reservations running over the end of the
+/// storage go to a small scratch space which is copied to the storage by finish().
+class ExactBuffer : public BufferImpl<ExactBuffer>
+{
+public:
+    /// The storage must be at least as large as the output.
+    ExactBuffer(char* const storage, const size_t size)
+        : m_storage{storage}
+        , m_size{size}
+    {
+        set_data(m_storage, 0, m_size);
+    }
+
+    ExactBuffer(const ExactBuffer&) = delete;
+    ExactBuffer& operator=(const ExactBuffer&) = delete;
+    ExactBuffer(ExactBuffer&&) = delete;
+    ExactBuffer& operator=(ExactBuffer&&) = delete;
+
+    ~ExactBuffer() override { finish(); }
+
+    /// Completes the data in the storage and returns its size. The buffer is not usable
+    /// afterwards.
+    size_t finish() noexcept
+    {
+        if (data() == m_scratch.data()) {
+            move_scratch(size());
+            reset_data(m_storage, m_written, m_size);
+        }
+        return size();
+    }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        if (new_capacity - data_size > m_scratch.size()) {
+            // larger than any reservation of the built-in formatters
+            assert(false);
+            std::abort();
+        }
+        if (data() == m_scratch.data()) {
+            move_scratch(data_size);
+            record_copy(data_size);
+        } else {
+            m_written = data_size;
+        }
+        reset_data(m_scratch.data(), 0, m_scratch.size());
     }
 
-private:
-    void move_from(SimpleBuffer&& other)
+protected:
+    size_t passed_on() const noexcept override
     {
-        if (&other != this) {
-            const auto old_size = other.size();
-
-            if (other.m_ptr == other.m_static.data()) {
-                m_static = other.m_static;
-                m_ptr = m_static.data();
-            } else {
-                m_dynamic = std::move(other.m_dynamic);
-                m_ptr = m_dynamic.get();
-            }
-            m_capacity = other.m_capacity;
-
-            other.~SimpleBuffer();
-            new (&other) SimpleBuffer{};
+        return data() == m_scratch.data() ? m_written : 0;
+    }
 
-            set_data(m_ptr, old_size, m_capacity);
-            other.set_data(nullptr, 0, m_capacity);
+    /// The data moved to the storage stays there, it continues to be written in place.
+    void rewind(const size_t offset) override
+    {
+        if (data() == m_scratch.data() && offset < m_written) {
+            reset_data(m_storage, offset, m_size);
+        } else {
+            Buffer::rewind(offset);
         }
     }
 
-    using Dynamic = std::unique_ptr<char[]>;
+private:
+    void move_scratch(const size_t count) noexcept
+    {
+        assert(m_written + count <= m_size);
+        ::memcpy(m_storage + m_written, m_scratch.data(), count);
+        m_written += count;
+    }
 
-    std::array<char, INITIAL_FIXED_CAPACITY> m_static;
-    Dynamic m_dynamic{};
-    char* m_ptr{m_static.data()};
-    size_t m_capacity{m_static.size()};
+    char* const m_storage;
+    const size_t m_size;
+    /// in the storage while writing to the scratch space
+    size_t m_written{0};
+    std::array<char, detail::MAX_CURSOR_RESERVATION> m_scratch;
 };
 
-template<typename T>
-void write(Buffer& buffer, T&& value);
+template<typename BufferType, typename T>
+void write(BufferType& buffer, T&& value);
 
 namespace detail {
 
@@ -303,6 +1146,16 @@ struct EscapeMaps
 
 static constexpr EscapeMaps escape_maps{};
 
+/// Length of the escaped string including the quotes.
+inline size_t escaped_size(const std::string_view value) noexcept
+{
+    size_t size{2};
+    for (const char c : value) {
+        size += escape_maps.char_map[static_cast<uint8_t>(c)].second;
+    }
+    return size;
+}
+
 template<typename T>
 class HasWriteFunction
 {
@@ -323,6 +1176,87 @@ public:
     static const bool value = type::value;
 };
 
+template<typename BufferType>
+struct IsBuffer : std::bool_constant<std::is_base_of_v<Buffer, BufferType>
+                                     || std::is_same_v<BufferType, Cursor>>
+{ };
+
+/// Whether a write() member accepts the buffer type, otherwise a cursor falls back to Buffer&.
+template<typename T, typename BufferType, typename = void>
+struct HasWriteFunctionFor : std::false_type
+{ };
+template<typename T, typename BufferType>
+struct HasWriteFunctionFor<
+    T, BufferType, std::void_t<decltype(std::declval<T&>().write(std::declval<BufferType&>()))>>
+    : std::true_type
+{ };
+
+/// Whether Formatter<T>::write() accepts the buffer type, otherwise a cursor falls back to
+/// Buffer&.
+template<typename Formatter, typename BufferType, typename T, typename = void>
+struct FormatterAccepts : std::false_type
+{ };
+template<typename Formatter, typename BufferType, typename T>
+struct FormatterAccepts<
+    Formatter, BufferType, T,
+    std::void_t<decltype(Formatter::write(std::declval<BufferType&>(), std::declval<T>()))>>
+    : std::true_type
+{ };
+
+} // namespace detail
+
+/// Handling of NaN and infinities by the float formatters. JSON has no representation for them.
+enum class NonFinite {
+    /// `NaN`, `Infinity`, `-Infinity` as is, i.e. an invalid JSON.
+    passthrough,
+    /// `null`
+    null,
+    /// `"NaN"`, `"Infinity"`, `"-Infinity"`
+    string,
+    /// Throws NonFiniteError.
+    error,
+};
+
+class NonFiniteError : public std::domain_error
+{
+public:
+    NonFiniteError()
+        : std::domain_error{"non-finite number has no JSON representation"}
+    {
+    }
+};
+
+namespace detail {
+
+/// The longest output is `"-Infinity"` with quotes.
+static constexpr size_t NON_FINITE_MAX_LEN{11};
+
+template<NonFinite POLICY>
+char* write_non_finite(char* out, const bool is_nan, const bool is_negative)
+{
+    if constexpr (POLICY == NonFinite::null) {
+        return std::copy_n("null", 4, out);
+    } else if constexpr (POLICY == NonFinite::error) {
+        throw NonFiniteError{};
+    } else {
+        if constexpr (POLICY == NonFinite::string) {
+            *out++ = '"';
+        }
+        if (is_nan) {
+            out = std::copy_n("NaN", 3, out);
+        } else {
+            if (is_negative) {
+                *out++ = '-';
+            }
+            out = std::copy_n("Infinity", 8, out);
+        }
+        if constexpr (POLICY == NonFinite::string) {
+            *out++ = '"';
+        }
+        return out;
+    }
+}
+
 } // namespace detail
 
 /// Similar to fmt::formatter. Specialize the template for custom types.
@@ -333,12 +1267,74 @@ struct Formatter
     Formatter() = delete;
 };
 
+/// Upper bound of the room Formatter<T>::write() takes, known at compile time. It covers the
+/// output and any scratch writes past it, i.e. no make_room(count) of the formatter exceeds
+/// MAX_SIZE minus what it has written so far. Formatters of bounded types provide it as
+/// `static constexpr size_t MAX_SIZE`, composite types specialize the trait. `value` is missing
+/// for unbounded types. jsonwriter::write() makes room for such a value once and writes it
+/// through a Cursor.
+template<typename T, typename = void>
+struct max_serialized_size
+{ };
+template<typename T>
+struct max_serialized_size<T, std::void_t<decltype(Formatter<T>::MAX_SIZE)>>
+    : std::integral_constant<size_t, Formatter<T>::MAX_SIZE>
+{ };
+
+template<typename T>
+inline constexpr size_t max_serialized_size_v = max_serialized_size<T>::value;
+
+namespace detail {
+
+template<typename T, typename = void>
+struct HasMaxSerializedSize : std::false_type
+{ };
+template<typename T>
+struct HasMaxSerializedSize<T, std::void_t<decltype(max_serialized_size<T>::value)>>
+    : std::true_type
+{ };
+
+/// Room taken by the string formatter, see Formatter<std::string_view>.
+constexpr size_t max_string_size(const size_t length) { return 2 + length * 8; }
+
+/// Number of characters of the decimal integer including the sign.
+template<typename T>
+size_t decimal_length(const T value) noexcept
+{
+    // at least unsigned int, the arithmetic of smaller types is promoted to int
+    using Unsigned = std::make_unsigned_t<std::common_type_t<T, unsigned>>;
+    auto magnitude = static_cast<Unsigned>(value);
+    size_t length{1};
+    if constexpr (std::is_signed_v<T>) {
+        if (value < 0) {
+            magnitude = static_cast<Unsigned>(Unsigned{0} - magnitude);
+            ++length;
+        }
+    }
+    for (; magnitude >= 10000; magnitude /= 10000) {
+        length += 4;
+    }
+    return length + (magnitude >= 10) + (magnitude >= 100) + (magnitude >= 1000);
+}
+
+} // namespace detail
+
 template<typename T>
 struct Formatter<T, typename std::enable_if_t<std::is_integral_v<T>>>
 {
-    static void write(Buffer& buffer, const T value)
+    // digits + sign
+    static constexpr size_t MAX_SIZE{std::numeric_limits<T>::digits10 + 1
+                                     + (std::is_signed_v<T> ? 1 : 0)};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const T value)
     {
         static_assert(std::is_integral_v<T>);
+        if constexpr (std::is_same_v<BufferType, CountingBuffer>) {
+            buffer.add(detail::decimal_length(value));
+            return;
+        }
+
         FormatInt format_int{};
         const auto str = format_int.itostr(value);
         buffer.make_room(str.size());
@@ -346,14 +1342,47 @@ struct Formatter<T, typename std::enable_if_t<std::is_integral_v<T>>>
     }
 };
 
-template<typename FloatType>
+template<typename FloatType, NonFinite POLICY = NonFinite::JSONWRITER_NON_FINITE>
 struct FormatterFloat
 {
-    static void write(Buffer& buffer, const FloatType value)
+    static constexpr size_t MAX_LEN{
+        std::max(jkj::dragonbox::max_output_string_length<
+                     typename jkj::dragonbox::default_float_traits<FloatType>::format>,
+                 detail::NON_FINITE_MAX_LEN)};
+    static constexpr size_t MAX_SIZE{MAX_LEN};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const FloatType value)
+    {
+        buffer.make_room(MAX_LEN);
+        buffer.consume(to_chars(value, buffer.working_end()));
+    }
+
+    /// Writes at most MAX_LEN characters, returns the new end. The finiteness check is the
+    /// exponent inspection dragonbox needs anyway.
+    static char* to_chars(const FloatType value, char* out)
     {
-        buffer.make_room(jkj::dragonbox::max_output_string_length<FloatType>);
-        const auto end = jkj::dragonbox::to_chars_n(value, buffer.working_end());
-        buffer.consume(static_cast<size_t>(end - buffer.working_end()));
+        namespace dragonbox = jkj::dragonbox;
+        const auto br = dragonbox::float_bits<FloatType>(value);
+        const auto exponent_bits = br.extract_exponent_bits();
+        const auto s = br.remove_exponent_bits(exponent_bits);
+
+        if (!br.is_finite(exponent_bits)) {
+            return detail::write_non_finite<POLICY>(out, !s.has_all_zero_significand_bits(),
+                                                    s.is_negative());
+        }
+        if (s.is_negative()) {
+            *out++ = '-';
+        }
+        if (!br.is_nonzero()) {
+            return std::copy_n("0E0", 3, out);
+        }
+        const auto decimal = dragonbox::to_decimal<FloatType>(
+            s, exponent_bits, dragonbox::policy::sign::ignore,
+            dragonbox::policy::trailing_zero::remove);
+        return dragonbox::to_chars_detail::to_chars<FloatType,
+                                                    dragonbox::default_float_traits<FloatType>>(
+            decimal.significand, decimal.exponent, out);
     }
 };
 
@@ -364,10 +1393,63 @@ template<>
 struct Formatter<double> : FormatterFloat<double>
 { };
 
+/// 16-bit floats are printed with the shortest digits which round-trip to the 16-bit value, not
+/// to its float widening.
+template<typename T, NonFinite POLICY = NonFinite::JSONWRITER_NON_FINITE>
+struct FormatterFloat16
+{
+    static constexpr size_t MAX_LEN{
+        std::max(detail::Float16Format<T>::max_output_length, detail::NON_FINITE_MAX_LEN)};
+    static constexpr size_t MAX_SIZE{MAX_LEN};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const T value)
+    {
+        buffer.make_room(MAX_LEN);
+        buffer.consume(to_chars(value, buffer.working_end()));
+    }
+
+    /// Writes at most MAX_LEN characters, returns the new end.
+    static char* to_chars(const T value, char* out)
+    {
+        using Format = detail::Float16Format<T>;
+        constexpr uint32_t sign_mask{1u << (Format::significand_bits + Format::exponent_bits)};
+        constexpr uint32_t exponent_mask{((1u << Format::exponent_bits) - 1)
+                                         << Format::significand_bits};
+
+        const uint32_t bits{value.bits};
+        if ((bits & exponent_mask) == exponent_mask) {
+            return detail::write_non_finite<POLICY>(out, (bits & ~(sign_mask | exponent_mask)) != 0,
+                                                    (bits & sign_mask) != 0);
+        }
+
+        if ((bits & sign_mask) != 0) {
+            *out++ = '-';
+        }
+        if ((bits & ~sign_mask) == 0) {
+            return std::copy_n("0E0", 3, out);
+        }
+        const auto decimal = FormatFloat16::to_decimal(value);
+        using Traits = jkj::dragonbox::default_float_traits<float>;
+        return jkj::dragonbox::to_chars_detail::to_chars<float, Traits>(decimal.significand,
+                                                                        decimal.exponent, out);
+    }
+};
+
+template<>
+struct Formatter<Float16> : FormatterFloat16<Float16>
+{ };
+template<>
+struct Formatter<BFloat16> : FormatterFloat16<BFloat16>
+{ };
+
 template<>
 struct Formatter<bool>
 {
-    static void write(Buffer& buffer, const bool value)
+    static constexpr size_t MAX_SIZE{5};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const bool value)
     {
         if (value) {
             buffer.append("true");
@@ -380,8 +1462,14 @@ struct Formatter<bool>
 template<>
 struct Formatter<std::string_view>
 {
-    static void write(Buffer& buffer, const std::string_view value)
+    template<typename BufferType>
+    static void write(BufferType& buffer, const std::string_view value)
     {
+        if constexpr (std::is_same_v<BufferType, CountingBuffer>) {
+            buffer.add(detail::escaped_size(value));
+            return;
+        }
+
         // for two '"'
         buffer.make_room(2);
         buffer.append_no_grow('"');
@@ -390,10 +1478,10 @@ struct Formatter<std::string_view>
         while (it != value.end()) {
             static constexpr size_t BULK{64};
 
+            const size_t bulk_size = std::min(BULK, static_cast<size_t>(value.end() - it));
             // enough room for all characters to be `\uXXXX` and a terminating '"'
-            buffer.make_room(std::max(BULK * detail::EscapeMaps::MAX_LEN + 1, buffer.room()));
+            buffer.make_room(bulk_size * detail::EscapeMaps::MAX_LEN + 1);
 
-            const size_t bulk_size = std::min(BULK, static_cast<size_t>(value.end() - it));
             for (size_t i{0}; i < bulk_size; ++i, ++it) {
                 const char c = *it;
                 const auto char_index = static_cast<uint8_t>(c);
@@ -422,7 +1510,10 @@ struct Formatter<std::string> : Formatter<std::string_view>
 template<size_t N>
 struct Formatter<char[N]>
 {
-    static void write(Buffer& buffer, const char* value)
+    static constexpr size_t MAX_SIZE{detail::max_string_size(N - 1)};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const char* value)
     {
         // -1 to avoid the null termination character
         jsonwriter::write(buffer, std::string_view{value, N - 1});
@@ -432,7 +1523,10 @@ struct Formatter<char[N]>
 template<>
 struct Formatter<char>
 {
-    static void write(Buffer& buffer, const char value)
+    static constexpr size_t MAX_SIZE{detail::max_string_size(1)};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const char value)
     {
         jsonwriter::write(buffer, std::string_view{&value, 1});
     }
@@ -441,13 +1535,17 @@ struct Formatter<char>
 template<>
 struct Formatter<std::nullopt_t>
 {
-    static void write(Buffer& buffer, const std::nullopt_t) { buffer.append("null"); }
+    static constexpr size_t MAX_SIZE{4};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const std::nullopt_t) { buffer.append("null"); }
 };
 
 template<typename T>
 struct Formatter<std::optional<T>>
 {
-    static void write(Buffer& buffer, const std::optional<T>& value)
+    template<typename BufferType>
+    static void write(BufferType& buffer, const std::optional<T>& value)
     {
         if (value.has_value()) {
             jsonwriter::write(buffer, *value);
@@ -457,39 +1555,114 @@ struct Formatter<std::optional<T>>
     }
 };
 
-class ListProxy : private detail::NoCopyMove
+template<typename T>
+struct max_serialized_size<std::optional<T>,
+                           std::enable_if_t<detail::HasMaxSerializedSize<T>::value>>
+    : std::integral_constant<size_t, std::max(max_serialized_size_v<T>, size_t{4})>
+{ };
+
+namespace detail {
+
+/// Makes the separator state of a proxy the one restored by Buffer::rollback() for the proxy
+/// lifetime.
+class SeparatorScope : private NoCopyMove
+{
+public:
+    SeparatorScope(Buffer& buffer, bool& first) noexcept
+        : m_buffer{buffer}
+        , m_outer{std::exchange(buffer.m_first, &first)}
+    {
+    }
+
+    ~SeparatorScope() { m_buffer.m_first = m_outer; }
+
+private:
+    Buffer& m_buffer;
+    bool* m_outer;
+};
+
+/// Separator state shared by the list proxies.
+class ListProxyBase : private NoCopyMove
+{
+public:
+    ListProxyBase() = default;
+    /// The cursor proxies have no type-erased part.
+    explicit ListProxyBase(Cursor&) {}
+
+protected:
+    template<typename BufferType, typename T>
+    void push_back_impl(BufferType& buffer, const T& value)
+    {
+        if (!m_first) {
+            buffer.append(',');
+        }
+        jsonwriter::write(buffer, value);
+        m_first = false;
+    }
+
+    bool m_first{true};
+};
+
+} // namespace detail
+
+/// Type-erased list proxy, it can be taken by non-template callbacks.
+class ListProxy : public detail::ListProxyBase
 {
 public:
     ListProxy(Buffer& buffer)
         : m_buffer{buffer}
+        , m_scope{buffer, m_first}
     {
     }
 
     template<typename T>
     void push_back(const T& value)
     {
-        push_back_impl(value);
+        push_back_impl(m_buffer, value);
     }
 
     template<typename T>
     void push_back(const std::initializer_list<T> value)
     {
-        push_back_impl(value);
+        push_back_impl(m_buffer, value);
     }
 
 private:
+    Buffer& m_buffer;
+    detail::SeparatorScope m_scope;
+};
+
+/// List proxy writing through the concrete buffer type. It is still usable as ListProxy&,
+/// except for a cursor which must not be bypassed by the type-erased writes.
+template<typename BufferType>
+class BasicListProxy
+    : public std::conditional_t<std::is_base_of_v<Buffer, BufferType>, ListProxy,
+                                detail::ListProxyBase>
+{
+public:
+    using Base = std::conditional_t<std::is_base_of_v<Buffer, BufferType>, ListProxy,
+                                    detail::ListProxyBase>;
+
+    BasicListProxy(BufferType& buffer)
+        : Base{buffer}
+        , m_buffer{buffer}
+    {
+    }
+
     template<typename T>
-    void push_back_impl(const T& value)
+    void push_back(const T& value)
     {
-        if (!m_first) {
-            m_buffer.append(',');
-        }
-        jsonwriter::write(m_buffer, value);
-        m_first = false;
+        this->push_back_impl(m_buffer, value);
     }
 
-    Buffer& m_buffer;
-    bool m_first{true};
+    template<typename T>
+    void push_back(const std::initializer_list<T> value)
+    {
+        this->push_back_impl(m_buffer, value);
+    }
+
+private:
+    BufferType& m_buffer;
 };
 
 template<typename Callback>
@@ -515,10 +1688,11 @@ private:
 template<typename Callback>
 struct Formatter<List<Callback>>
 {
-    static void write(Buffer& buffer, const List<Callback>& value)
+    template<typename BufferType>
+    static void write(BufferType& buffer, const List<Callback>& value)
     {
         buffer.append('[');
-        ListProxy proxy{buffer};
+        BasicListProxy<BufferType> proxy{buffer};
         value.m_callback(proxy);
         buffer.append(']');
     }
@@ -526,8 +1700,8 @@ struct Formatter<List<Callback>>
 
 struct FormatterList
 {
-    template<typename Container>
-    static void write(Buffer& buffer, const Container& container)
+    template<typename BufferType, typename Container>
+    static void write(BufferType& buffer, const Container& container)
     {
         buffer.append('[');
         auto it = container.begin();
@@ -543,10 +1717,71 @@ struct FormatterList
     }
 };
 
+/// Contiguous 16-bit floats (e.g. an embedding vector) do a single capacity check per bulk of
+/// items instead of one per character.
+template<typename T, NonFinite POLICY = NonFinite::JSONWRITER_NON_FINITE>
+struct FormatterFloat16List
+{
+    template<typename BufferType, typename Container>
+    static void write(BufferType& buffer, const Container& container)
+    {
+        static constexpr size_t BULK{64};
+        // an item and a separator
+        static constexpr size_t ITEM_MAX_LEN{FormatterFloat16<T, POLICY>::MAX_LEN + 1};
+
+        const T* it = container.data();
+        const T* const end = it + container.size();
+
+        // '[' + first item + ']'
+        buffer.make_room(ITEM_MAX_LEN + 2);
+        buffer.append_no_grow('[');
+        if (it != end) {
+            buffer.consume(FormatterFloat16<T, POLICY>::to_chars(*it, buffer.working_end()));
+            ++it;
+        }
+        while (it != end) {
+            const size_t bulk_size = std::min(BULK, static_cast<size_t>(end - it));
+            // enough room for the whole bulk and a terminating ']'
+            buffer.make_room(bulk_size * ITEM_MAX_LEN + 1);
+            char* out = buffer.working_end();
+            for (size_t i{0}; i < bulk_size; ++i, ++it) {
+                *out++ = ',';
+                out = FormatterFloat16<T, POLICY>::to_chars(*it, out);
+            }
+            buffer.consume(out);
+        }
+        buffer.append_no_grow(']');
+    }
+};
+
+/// Non-owning view of a contiguous array, serialized as a list.
+template<typename T>
+class Span
+{
+public:
+    Span(const T* data, const size_t size)
+        : m_data{data}
+        , m_size{size}
+    {
+    }
+
+    const T* data() const noexcept { return m_data; }
+    size_t size() const noexcept { return m_size; }
+    const T* begin() const noexcept { return m_data; }
+    const T* end() const noexcept { return m_data + m_size; }
+
+private:
+    const T* m_data;
+    size_t m_size;
+};
+
 template<typename T>
 struct Formatter<std::initializer_list<T>> : FormatterList
 { };
 template<typename T>
+struct Formatter<Span<T>> : FormatterList
+{ };
+template<typename T>
 struct Formatter<std::vector<T>> : FormatterList
 { };
 template<typename T, size_t N>
@@ -562,14 +1797,48 @@ template<typename T>
 struct Formatter<std::list<T>> : FormatterList
 { };
 
-/// A proxy to provide `object[key] = value` semantics.
-class ObjectProxy : private detail::NoCopyMove
+template<>
+struct Formatter<Span<Float16>> : FormatterFloat16List<Float16>
+{ };
+template<>
+struct Formatter<Span<BFloat16>> : FormatterFloat16List<BFloat16>
+{ };
+template<>
+struct Formatter<std::vector<Float16>> : FormatterFloat16List<Float16>
+{ };
+template<>
+struct Formatter<std::vector<BFloat16>> : FormatterFloat16List<BFloat16>
+{ };
+template<size_t N>
+struct Formatter<std::array<Float16, N>> : FormatterFloat16List<Float16>
+{ };
+template<size_t N>
+struct Formatter<std::array<BFloat16, N>> : FormatterFloat16List<BFloat16>
+{ };
+
+/// Brackets and every item with a separator. At least one item for FormatterFloat16List.
+template<typename T, size_t N>
+struct max_serialized_size<std::array<T, N>,
+                           std::enable_if_t<detail::HasMaxSerializedSize<T>::value>>
+    : std::integral_constant<size_t, 2 + std::max(N, size_t{1}) * (max_serialized_size_v<T> + 1)>
+{ };
+
+namespace detail {
+
+/// Separator state shared by the object proxies.
+class ObjectProxyBase : private NoCopyMove
 {
-private:
-    class AssignmentProxy : private detail::NoCopyMove
+public:
+    ObjectProxyBase() = default;
+    /// The cursor proxies have no type-erased part.
+    explicit ObjectProxyBase(Cursor&) {}
+
+protected:
+    template<typename BufferType>
+    class AssignmentProxy : private NoCopyMove
     {
     public:
-        AssignmentProxy(Buffer& buffer)
+        AssignmentProxy(BufferType& buffer)
             : m_buffer{buffer}
         {
         }
@@ -587,29 +1856,71 @@ private:
         }
 
     private:
-        Buffer& m_buffer;
+        BufferType& m_buffer;
     };
 
+    template<typename BufferType>
+    AssignmentProxy<BufferType> add_key(BufferType& buffer, const std::string_view key)
+    {
+        if (!m_first) {
+            buffer.append(',');
+        }
+        m_first = false;
+        Formatter<std::string_view>::write(buffer, key);
+        buffer.append(':');
+        return AssignmentProxy<BufferType>{buffer};
+    }
+
+    bool m_first{true};
+};
+
+} // namespace detail
+
+/// A proxy to provide `object[key] = value` semantics. Type-erased, it can be taken by
+/// non-template callbacks.
+class ObjectProxy : public detail::ObjectProxyBase
+{
 public:
     ObjectProxy(Buffer& buffer)
         : m_buffer{buffer}
+        , m_scope{buffer, m_first}
     {
     }
 
-    AssignmentProxy operator[](const std::string_view key)
+    AssignmentProxy<Buffer> operator[](const std::string_view key)
     {
-        if (!m_first) {
-            m_buffer.append(',');
-        }
-        m_first = false;
-        Formatter<std::string_view>::write(m_buffer, key);
-        m_buffer.append(':');
-        return AssignmentProxy{m_buffer};
+        return add_key(m_buffer, key);
     }
 
 private:
     Buffer& m_buffer;
-    bool m_first{true};
+    detail::SeparatorScope m_scope;
+};
+
+/// Object proxy writing through the concrete buffer type. It is still usable as ObjectProxy&,
+/// except for a cursor which must not be bypassed by the type-erased writes.
+template<typename BufferType>
+class BasicObjectProxy
+    : public std::conditional_t<std::is_base_of_v<Buffer, BufferType>, ObjectProxy,
+                                detail::ObjectProxyBase>
+{
+public:
+    using Base = std::conditional_t<std::is_base_of_v<Buffer, BufferType>, ObjectProxy,
+                                    detail::ObjectProxyBase>;
+
+    BasicObjectProxy(BufferType& buffer)
+        : Base{buffer}
+        , m_buffer{buffer}
+    {
+    }
+
+    typename Base::template AssignmentProxy<BufferType> operator[](const std::string_view key)
+    {
+        return this->add_key(m_buffer, key);
+    }
+
+private:
+    BufferType& m_buffer;
 };
 
 template<typename Callback>
@@ -635,10 +1946,11 @@ private:
 template<typename Callback>
 struct Formatter<Object<Callback>>
 {
-    static void write(Buffer& buffer, const Object<Callback>& value)
+    template<typename BufferType>
+    static void write(BufferType& buffer, const Object<Callback>& value)
     {
         buffer.append('{');
-        ObjectProxy proxy{buffer};
+        BasicObjectProxy<BufferType> proxy{buffer};
         value.m_callback(proxy);
         buffer.append('}');
     }
@@ -652,27 +1964,93 @@ constexpr inline struct EmptyObject
 template<>
 struct Formatter<EmptyObject>
 {
-    static void write(Buffer& buffer, const EmptyObject&) { buffer.append("{}"); }
+    static constexpr size_t MAX_SIZE{2};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const EmptyObject&) { buffer.append("{}"); }
 };
 
 /// JSON serialization without inherent memory allocations. See tests for usage.
-template<typename T>
-void write(Buffer& buffer, T&& value)
+/// The concrete buffer type lets the compiler inline the whole write path including the growth.
+template<typename BufferType, typename T>
+void write(BufferType& buffer, T&& value)
 {
+    static_assert(detail::IsBuffer<BufferType>::value);
     using RawT = std::remove_cv_t<std::remove_reference_t<T>>;
+    constexpr bool is_cursor{std::is_same_v<BufferType, Cursor>};
     if constexpr (detail::HasWriteFunction<RawT>::value) {
-        value.write(buffer);
+        if constexpr (is_cursor
+                      && !detail::HasWriteFunctionFor<std::remove_reference_t<T>, Cursor>::value) {
+            buffer.with_buffer([&value](Buffer& erased) { value.write(erased); });
+        } else {
+            value.write(buffer);
+        }
+    } else if constexpr (is_cursor
+                         && !detail::FormatterAccepts<Formatter<RawT>, Cursor, T&&>::value) {
+        buffer.with_buffer(
+            [&value](Buffer& erased) { Formatter<RawT>::write(erased, std::forward<T>(value)); });
+    } else if constexpr (!is_cursor && !std::is_same_v<BufferType, CountingBuffer>
+                         && detail::HasMaxSerializedSize<RawT>::value
+                         && detail::FormatterAccepts<Formatter<RawT>, Cursor, T&&>::value) {
+        // a single capacity check for the whole value
+        constexpr size_t max_size{max_serialized_size_v<RawT>};
+        if constexpr (max_size <= detail::MAX_CURSOR_RESERVATION) {
+            auto cursor = buffer.reserve_cursor(max_size);
+            Formatter<RawT>::write(cursor, std::forward<T>(value));
+        } else {
+            Formatter<RawT>::write(buffer, std::forward<T>(value));
+        }
     } else {
         Formatter<RawT>::write(buffer, std::forward<T>(value));
     }
 }
 
-template<typename T>
-void write(Buffer& buffer, const std::initializer_list<T> value)
+template<typename BufferType, typename T>
+void write(BufferType& buffer, const std::initializer_list<T> value)
 {
     FormatterList::write(buffer, value);
 }
 
+/// max_serialized_size of an Object with the given keys and bounded values in the same order.
+/// Use it for MAX_SIZE of custom formatters, e.g.
+/// `max_object_size<int, bool>({{"id", "valid"}})`.
+template<typename... Values>
+constexpr size_t max_object_size(const std::array<std::string_view, sizeof...(Values)>& keys)
+{
+    // braces, separators, colons
+    size_t size{2 + sizeof...(Values) * 2};
+    for (const auto key : keys) {
+        size += detail::max_string_size(key.size());
+    }
+    return (size + ... + max_serialized_size_v<Values>);
+}
+
+/// Size of the serialized value, computed by a dry run without storing the output.
+template<typename T>
+size_t serialized_size(const T& value)
+{
+    CountingBuffer counter{};
+    write(counter, value);
+    return counter.count();
+}
+
+/// Two-pass serialization into storage of the exact size, e.g. from an arena or after a header
+/// with the size. `allocate(size)` returns the storage for `size` characters. The value is
+/// written twice, the callbacks of Object and List must give the same output both times.
+/// Object and List only reference their callback, pass a named callable to keep them past the
+/// full expression. Returns the size.
+template<typename T, typename Allocate>
+size_t write_exact(const T& value, Allocate&& allocate)
+{
+    const size_t size{serialized_size(value)};
+    ExactBuffer out{allocate(size), size};
+    write(out, value);
+    [[maybe_unused]] const size_t written{out.finish()};
+    assert(written == size);
+    return size;
+}
+
+} // inline namespace JSONWRITER_ABI
 } // namespace jsonwriter
 
 #endif /* include guard */
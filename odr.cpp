@@ -1,3 +1,15 @@
-// Just test ODR.
+// Just test ODR. This translation unit uses another NonFinite policy than test.cpp, which must
+// not change the float formatters of the latter.
 
+#define JSONWRITER_NON_FINITE null
 #include "jsonwriter/writer.hpp"
+
+#include <limits>
+#include <string>
+
+std::string odr_write_nan()
+{
+    jsonwriter::SimpleBuffer out{};
+    jsonwriter::write(out, std::numeric_limits<double>::quiet_NaN());
+    return std::string{out.begin(), out.end()};
+}
@@ -1,9 +1,36 @@
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <numeric>
+#include <thread>
 #include <vector>
 
 #include <gtest/gtest.h>
 
+#include "jsonwriter/pmr.hpp"
+#include "jsonwriter/pool.hpp"
 #include "jsonwriter/writer.hpp"
 
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "jsonwriter/chain.hpp"
+#include "jsonwriter/fd.hpp"
+#include "jsonwriter/mmap.hpp"
+#include "jsonwriter/socket.hpp"
+#include "jsonwriter/thread.hpp"
+#endif
+#ifdef __linux__
+#include "jsonwriter/uring.hpp"
+#endif
+#if __has_include(<zlib.h>)
+#include "jsonwriter/deflate.hpp"
+#endif
+
 int main(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -51,6 +78,13 @@ TEST(TestJsonBuffer, GrowConsume)
     EXPECT_EQ((std::string_view{out.data(), 900}), (std::string_view{long_data.data(), 900}));
 }
 
+/// Derived buffer with an own member, moved by the defaulted members.
+class TaggedBuffer : public jsonwriter::SimpleBuffer<16>
+{
+public:
+    std::string tag{};
+};
+
 TEST(TestJsonBuffer, Move)
 {
     {
@@ -85,6 +119,145 @@ TEST(TestJsonBuffer, Move)
             EXPECT_TRUE(orig.begin() == nullptr);
         }
     }
+
+    {
+        // dynamic data is taken over, a grown buffer can take small data
+        jsonwriter::SimpleBuffer<16> large{};
+        large.make_room(1000);
+        large.consume(std::copy_n(long_data.begin(), 1000, large.working_end()));
+        const auto large_data = large.data();
+
+        jsonwriter::SimpleBuffer<16> newbuf{std::move(large)};
+        EXPECT_EQ(newbuf.data(), large_data);
+        EXPECT_EQ((std::string_view{newbuf.data(), newbuf.size()}),
+                  (std::string_view{long_data.data(), 1000}));
+
+        jsonwriter::SimpleBuffer<16> small{};
+        small.append('x');
+        newbuf = std::move(small);
+        EXPECT_EQ(to_str(newbuf), "x");
+        newbuf.make_room(100);
+        EXPECT_EQ(to_str(newbuf), "x");
+    }
+
+    {
+        // the defaulted members of a derived buffer
+        TaggedBuffer large{};
+        large.tag = std::string(100, 't');
+        large.context = 42;
+        large.make_room(1000);
+        large.consume(std::copy_n(long_data.begin(), 1000, large.working_end()));
+
+        TaggedBuffer newbuf{};
+        newbuf.tag = "new";
+        newbuf = std::move(large);
+        EXPECT_EQ(newbuf.tag, std::string(100, 't'));
+        EXPECT_EQ(std::any_cast<int>(newbuf.context), 42);
+        EXPECT_EQ((std::string_view{newbuf.data(), newbuf.size()}),
+                  (std::string_view{long_data.data(), 1000}));
+
+        TaggedBuffer small{};
+        small.tag = "small";
+        small.append('x');
+        newbuf = std::move(small);
+        EXPECT_EQ(newbuf.tag, "small");
+        EXPECT_EQ(to_str(newbuf), "x");
+        jsonwriter::write(newbuf, std::string(100, 'y'));
+        EXPECT_EQ(to_str(newbuf), "x\"" + std::string(100, 'y') + "\"");
+    }
+}
+
+TEST(TestJsonBuffer, GrowthPolicy)
+{
+    EXPECT_EQ(jsonwriter::GrowthFactor<>::next_capacity(1024, 1025), 1536u);
+    EXPECT_EQ(jsonwriter::GrowthFactor<>::next_capacity(1024, 2000), 2000u);
+    EXPECT_EQ((jsonwriter::GrowthFactor<2, 1>::next_capacity(1024, 1025)), 2048u);
+    EXPECT_EQ(jsonwriter::GrowthSizeClasses<>::next_capacity(1, 10), 16u);
+    EXPECT_EQ(jsonwriter::GrowthSizeClasses<>::next_capacity(1024, 1025), 1536u);
+    EXPECT_EQ(jsonwriter::GrowthSizeClasses<>::next_capacity(1024, 1300), 1536u);
+    EXPECT_EQ(jsonwriter::GrowthSizeClasses<>::next_capacity(4096, 6500), 7168u);
+    EXPECT_EQ(jsonwriter::GrowthSizeClasses<>::next_capacity(4096, 4097), 6144u);
+    EXPECT_EQ(jsonwriter::GrowthHugePages<>::next_capacity(1024, 1025), 1536u);
+    EXPECT_EQ(jsonwriter::GrowthHugePages<>::next_capacity(2 << 20, 2 << 20), 4u << 20);
+    EXPECT_EQ(jsonwriter::GrowthHugePages<>::next_capacity(1024, 5 << 20), 6u << 20);
+
+    jsonwriter::SimpleBuffer<16, jsonwriter::GrowthSizeClasses<>> out{};
+    jsonwriter::write(out, std::vector<int>(1000, 1));
+    EXPECT_EQ(out.size(), 2001u);
+    EXPECT_EQ(out.capacity() % 256, 0u);
+}
+
+TEST(TestJsonBuffer, Shrink)
+{
+    jsonwriter::SimpleBuffer<16> out{};
+    jsonwriter::write(out, std::vector<int>(1000, 1));
+    out.clear();
+    jsonwriter::write(out, std::vector<int>(100, 1));
+    EXPECT_GT(out.capacity(), 2000u);
+    out.shrink_to_fit();
+    EXPECT_EQ(out.capacity(), 201u);
+    EXPECT_EQ(to_str(out).substr(0, 4), "[1,1");
+    EXPECT_EQ(to_str(out).size(), 201u);
+    out.clear();
+    jsonwriter::write(out, 5);
+    out.shrink_to_fit();
+    EXPECT_EQ(out.capacity(), 16u);
+    EXPECT_EQ(to_str(out), "5");
+
+    // headroom kept
+    jsonwriter::SimpleBuffer<16> framed{};
+    framed.reserve_headroom(8);
+    jsonwriter::write(framed, std::vector<int>(100, 1));
+    framed.shrink_to_fit();
+    EXPECT_EQ(framed.capacity(), 201u);
+    framed.prepend("x");
+    EXPECT_EQ(to_str(framed).substr(0, 3), "x[1");
+
+    jsonwriter::SimpleBuffer<16, jsonwriter::GrowthFactor<>, jsonwriter::ShrinkAfter<3>> decaying{};
+    jsonwriter::write(decaying, std::vector<int>(1000, 1));
+    const auto peak_capacity = decaying.capacity();
+    decaying.clear();
+    for (int i{0}; i < 2; ++i) {
+        jsonwriter::write(decaying, std::vector<int>(10, 1));
+        decaying.clear();
+        EXPECT_EQ(decaying.capacity(), peak_capacity);
+    }
+    // a large document restarts the count
+    jsonwriter::write(decaying, std::vector<int>(1000, 1));
+    decaying.clear();
+    for (int i{0}; i < 2; ++i) {
+        jsonwriter::write(decaying, std::vector<int>(i == 0 ? 10 : 100, 1));
+        decaying.clear();
+        EXPECT_EQ(decaying.capacity(), peak_capacity);
+    }
+    jsonwriter::write(decaying, std::vector<int>(10, 1));
+    decaying.clear();
+    // the largest of the small ones
+    EXPECT_EQ(decaying.capacity(), 201u);
+
+    // cleared through the base class too
+    jsonwriter::write(decaying, std::vector<int>(1000, 1));
+    jsonwriter::Buffer& erased = decaying;
+    for (int i{0}; i < 3; ++i) {
+        erased.clear();
+        jsonwriter::write(decaying, std::vector<int>(10, 1));
+    }
+    erased.clear();
+    EXPECT_EQ(decaying.capacity(), 21u);
+
+    // clearing an empty buffer isn't a small document
+    jsonwriter::write(decaying, std::vector<int>(1000, 1));
+    decaying.clear();
+    const auto regrown_capacity = decaying.capacity();
+    for (int i{0}; i < 2; ++i) {
+        jsonwriter::write(decaying, std::vector<int>(i == 0 ? 10 : 100, 1));
+        decaying.clear();
+        decaying.clear();
+        EXPECT_EQ(decaying.capacity(), regrown_capacity);
+    }
+    jsonwriter::write(decaying, std::vector<int>(10, 1));
+    decaying.clear();
+    EXPECT_EQ(decaying.capacity(), 201u);
 }
 
 TEST(TestJsonBuffer, Clear)
@@ -103,6 +276,1037 @@ TEST(TestJsonBuffer, Clear)
     EXPECT_EQ((std::string_view{out.begin(), out.size()}), (std::string_view{long_data.data(), 5}));
 }
 
+#if __has_include(<zlib.h>)
+static std::string decompress(const std::string& compressed, const int window_bits)
+{
+    z_stream stream{};
+    EXPECT_EQ(inflateInit2(&stream, window_bits), Z_OK);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    stream.avail_in = static_cast<uInt>(compressed.size());
+    std::string result{};
+    int status{Z_OK};
+    while (status == Z_OK) {
+        std::array<char, 4096> chunk{};
+        stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+        stream.avail_out = static_cast<uInt>(chunk.size());
+        status = inflate(&stream, Z_NO_FLUSH);
+        result.append(chunk.data(), chunk.size() - stream.avail_out);
+    }
+    EXPECT_EQ(status, Z_STREAM_END);
+    inflateEnd(&stream);
+    return result;
+}
+
+TEST(TestJsonBuffer, DeflateBuffer)
+{
+    std::vector<std::string> document{};
+    for (int i{0}; i < 10000; ++i) {
+        document.push_back(std::to_string(i * 7919 % 10007)
+                           + std::string(static_cast<size_t>(i % 70), 'x'));
+    }
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    const std::pair<jsonwriter::DeflateFormat, int> formats[]{
+        {jsonwriter::DeflateFormat::gzip, 15 + 16},
+        {jsonwriter::DeflateFormat::zlib, 15},
+        {jsonwriter::DeflateFormat::raw, -15},
+    };
+    for (const auto& [format, window_bits] : formats) {
+        jsonwriter::SimpleBuffer compressed{};
+        {
+            jsonwriter::DeflateBuffer out{compressed, format, Z_DEFAULT_COMPRESSION, 1000};
+            jsonwriter::write(out, document);
+            // only a chunk of the raw document in memory
+            EXPECT_LE(out.capacity(), 1000u);
+            out.finish();
+            EXPECT_EQ(out.flushed(), expected.size());
+            EXPECT_EQ(out.compressed(), compressed.size());
+        }
+        EXPECT_LT(compressed.size(), expected.size() / 2);
+        EXPECT_EQ(decompress(to_str(compressed), window_bits), to_str(expected));
+    }
+
+    // finished by the destructor
+    std::string compressed{};
+    {
+        jsonwriter::StringBuffer target{compressed};
+        {
+            jsonwriter::DeflateBuffer out{target};
+            jsonwriter::write(out, "abc");
+        }
+    }
+    EXPECT_EQ(decompress(compressed, 15 + 16), "\"abc\"");
+}
+#endif
+
+TEST(TestJsonBuffer, Headroom)
+{
+    jsonwriter::SimpleBuffer<16> out{};
+    out.reserve_headroom(32);
+    EXPECT_EQ(out.headroom(), 32u);
+    EXPECT_EQ(out.size(), 0u);
+
+    // the headroom survives the growth
+    jsonwriter::write(out, std::vector<int>(100, 1));
+    EXPECT_EQ(out.headroom(), 32u);
+    const auto body_size = out.size();
+    const char* const body = out.data();
+
+    const auto header = "Content-Length: " + std::to_string(body_size) + "\r\n\r\n";
+    out.prepend(header);
+    EXPECT_EQ(out.headroom(), 32u - header.size());
+    EXPECT_EQ(out.data() + header.size(), body);
+    const std::string_view framed{out.data(), out.size()};
+    EXPECT_EQ(framed.substr(0, header.size()), header);
+    EXPECT_EQ(framed.substr(header.size(), 4), "[1,1");
+    EXPECT_EQ(framed.size(), header.size() + body_size);
+
+    // length prefix
+    const auto length = static_cast<uint32_t>(out.size());
+    std::memcpy(out.push_front(sizeof(length)), &length, sizeof(length));
+    EXPECT_EQ(out.size(), header.size() + body_size + sizeof(length));
+
+    jsonwriter::SimpleBuffer<16> moved{std::move(out)};
+    EXPECT_EQ(moved.headroom(), 32u - header.size() - sizeof(length));
+    EXPECT_EQ((std::string_view{moved.data() + sizeof(length), header.size()}), header);
+
+    moved.clear();
+    EXPECT_EQ(moved.headroom(), 0u);
+    jsonwriter::write(moved, 1);
+    EXPECT_EQ((std::string_view{moved.data(), moved.size()}), "1");
+
+    // the static part moves too
+    jsonwriter::SimpleBuffer<64> small{};
+    small.reserve_headroom(8);
+    jsonwriter::write(small, true);
+    small.prepend("a");
+    jsonwriter::SimpleBuffer<64> small_moved{std::move(small)};
+    EXPECT_EQ((std::string_view{small_moved.data(), small_moved.size()}), "atrue");
+    EXPECT_EQ(small_moved.headroom(), 7u);
+
+    std::string target{};
+    {
+        jsonwriter::StringBuffer string_out{target};
+        string_out.reserve_headroom(8);
+        jsonwriter::write(string_out, "x");
+        string_out.prepend("1:");
+    }
+    EXPECT_EQ(target, "1:\"x\"");
+
+    jsonwriter::FixedBuffer<16> fixed{};
+    fixed.reserve_headroom(4);
+    jsonwriter::write(fixed, 123);
+    fixed.mark();
+    jsonwriter::write(fixed, std::string(20, 'x'));
+    fixed.prepend("n");
+    EXPECT_TRUE(fixed.overflowed());
+    EXPECT_EQ(fixed.view(), "n123\"xxxxxxxx");
+    EXPECT_EQ(fixed.complete_view(), "n123");
+}
+
+TEST(TestJsonBuffer, CountingBuffer)
+{
+    std::vector<std::string> strings{};
+    for (int i{0}; i < 200; ++i) {
+        strings.push_back(std::string(static_cast<size_t>(i), static_cast<char>(i)));
+    }
+    // Object references the callback
+    const auto write_members = [&strings](auto& object) {
+        object["strings"] = strings;
+        object["k\n"] = jsonwriter::List{[](jsonwriter::ListProxy& list) {
+            list.push_back(std::vector<double>(1000, 1.25));
+            list.push_back("x\"y");
+        }};
+        object["int"] = -42;
+    };
+    const auto document = jsonwriter::Object{write_members};
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    jsonwriter::CountingBuffer counter{};
+    jsonwriter::write(counter, document);
+    EXPECT_EQ(counter.count(), expected.size());
+    EXPECT_EQ(jsonwriter::serialized_size(document), expected.size());
+    EXPECT_EQ(jsonwriter::serialized_size(1), 1u);
+    EXPECT_EQ(jsonwriter::serialized_size("\u0001"), 8u);
+    const auto expect_int_size = [](const auto value) {
+        EXPECT_EQ(jsonwriter::serialized_size(value), std::to_string(value).size()) << value;
+    };
+    for (int64_t value{1}; value < std::numeric_limits<int64_t>::max() / 10; value *= 10) {
+        for (const int64_t delta : {-1, 0, 1}) {
+            expect_int_size(value + delta);
+            expect_int_size(-value - delta);
+        }
+    }
+    expect_int_size(std::numeric_limits<int8_t>::min());
+    expect_int_size(std::numeric_limits<uint8_t>::max());
+    expect_int_size(std::numeric_limits<int64_t>::min());
+    expect_int_size(std::numeric_limits<int64_t>::max());
+    expect_int_size(std::numeric_limits<uint64_t>::max());
+
+    std::string exact{};
+    const auto size = jsonwriter::write_exact(document, [&exact](const size_t count) {
+        exact.resize(count);
+        return exact.data();
+    });
+    EXPECT_EQ(size, expected.size());
+    EXPECT_EQ(exact, to_str(expected));
+
+    // a rolled back member is not counted
+    const auto write_filtered = [](auto& out) {
+        jsonwriter::write(out, jsonwriter::Object{[&out](auto& object) {
+                              object["a"] = 1;
+                              const auto mark = out.checkpoint();
+                              object["dropped"] = std::string(60, 'x');
+                              out.rollback(mark);
+                              object["b"] = 2;
+                          }});
+    };
+    jsonwriter::CountingBuffer filtered_counter{};
+    write_filtered(filtered_counter);
+    EXPECT_EQ(filtered_counter.count(), 13u);
+    char filtered[13];
+    jsonwriter::ExactBuffer filtered_out{filtered, sizeof(filtered)};
+    write_filtered(filtered_out);
+    EXPECT_EQ(filtered_out.finish(), 13u);
+    EXPECT_EQ((std::string_view{filtered, 13}), "{\"a\":1,\"b\":2}");
+
+    // the reservations over the end of a small storage
+    char storage[3];
+    jsonwriter::ExactBuffer out{storage, sizeof(storage)};
+    jsonwriter::write(out, 123);
+    EXPECT_EQ(out.finish(), 3u);
+    EXPECT_EQ((std::string_view{storage, 3}), "123");
+}
+
+/// Grows exactly as requested and counts it.
+class VectorBackedBuffer : public jsonwriter::BufferImpl<VectorBackedBuffer>
+{
+public:
+    VectorBackedBuffer() { set_data(m_storage.data(), 0, m_storage.size()); }
+
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        m_storage.resize(new_capacity);
+        set_data(m_storage.data(), data_size, new_capacity);
+        ++reallocs;
+    }
+
+    size_t reallocs{0};
+
+private:
+    std::vector<char> m_storage = std::vector<char>(4);
+};
+
+TEST(TestJsonBuffer, BufferImpl)
+{
+    const std::string long_string(100, 'x');
+    {
+        VectorBackedBuffer out{};
+        jsonwriter::write(out, std::vector<std::string>{long_string, long_string});
+        EXPECT_EQ(to_str(out), "[\"" + long_string + "\",\"" + long_string + "\"]");
+        EXPECT_GT(out.reallocs, 0u);
+    }
+    {
+        // type-erased
+        VectorBackedBuffer buffer{};
+        jsonwriter::Buffer& out{buffer};
+        jsonwriter::write(out, std::vector<std::string>{long_string, long_string});
+        EXPECT_EQ(to_str(out), "[\"" + long_string + "\",\"" + long_string + "\"]");
+        EXPECT_GT(buffer.reallocs, 0u);
+    }
+}
+
+/// Overrides the realloc() of a concrete buffer.
+class CountingSimpleBuffer : public jsonwriter::SimpleBuffer<16>
+{
+public:
+    void realloc(const size_t data_size, const size_t new_capacity) override
+    {
+        jsonwriter::SimpleBuffer<16>::realloc(data_size, new_capacity);
+        ++reallocs;
+    }
+
+    size_t reallocs{0};
+};
+
+TEST(TestJsonBuffer, BufferImplDerived)
+{
+    CountingSimpleBuffer out{};
+    jsonwriter::write(out, std::vector<int>(100, 1));
+    EXPECT_EQ(to_str(out).substr(0, 4), "[1,1");
+    EXPECT_GT(out.reallocs, 0u);
+    const auto reallocs = out.reallocs;
+    out.reserve(1000);
+    EXPECT_EQ(out.reallocs, reallocs + 1);
+}
+
+TEST(TestJsonBuffer, Pool)
+{
+    jsonwriter::BufferPool pool{16, 1024};
+    const char* data{nullptr};
+    {
+        auto out = pool.acquire();
+        jsonwriter::write(out, std::vector<int>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+        EXPECT_EQ(to_str(out), "[1,2,3,4,5,6,7,8,9,10]");
+        data = out.data();
+    }
+    const auto allocations = pool.allocations();
+    EXPECT_GT(allocations, 1u);
+    {
+        // the grown block is reused
+        auto out = pool.acquire();
+        EXPECT_EQ(out.data(), data);
+        EXPECT_EQ(out.size(), 0u);
+        EXPECT_GE(out.capacity(), 22u);
+
+        auto moved = std::move(out);
+        EXPECT_EQ(moved.data(), data);
+    }
+    EXPECT_EQ(pool.allocations(), allocations);
+    {
+        // grown over the retention limit
+        auto out = pool.acquire();
+        out.make_room(2000);
+        EXPECT_EQ(pool.allocations(), allocations + 1);
+    }
+    {
+        auto out = pool.acquire();
+        EXPECT_EQ(pool.allocations(), allocations + 2);
+        EXPECT_EQ(out.capacity(), 16u);
+    }
+}
+
+TEST(TestJsonBuffer, PoolThreads)
+{
+    static constexpr int THREADS{4};
+    // more than the thread cache so the global list is used too
+    static constexpr int LEASES{20};
+
+    jsonwriter::BufferPool pool{64};
+    std::atomic<int> failures{0};
+    std::atomic<int> arrived{0};
+    const auto wait_all = [&arrived](const int phase) {
+        ++arrived;
+        while (arrived.load() < THREADS * phase) {
+            std::this_thread::yield();
+        }
+    };
+    size_t warm_allocations{0};
+    std::vector<std::thread> threads{};
+    for (int t{0}; t < THREADS; ++t) {
+        threads.emplace_back([&pool, &failures, &wait_all, &warm_allocations, t]() {
+            {
+                // warm-up, all leases at once
+                std::vector<jsonwriter::PooledBuffer> leases{};
+                for (int j{0}; j < LEASES; ++j) {
+                    leases.push_back(pool.acquire());
+                }
+                wait_all(1);
+            }
+            wait_all(2);
+            if (t == 0) {
+                warm_allocations = pool.allocations();
+            }
+            wait_all(3);
+
+            for (int i{0}; i < 200; ++i) {
+                std::vector<jsonwriter::PooledBuffer> leases{};
+                for (int j{0}; j < LEASES; ++j) {
+                    leases.push_back(pool.acquire());
+                    jsonwriter::write(leases.back(), std::array<int, 3>{{t, i, j}});
+                }
+                for (int j{0}; j < LEASES; ++j) {
+                    const auto expected = "[" + std::to_string(t) + "," + std::to_string(i) + ","
+                                          + std::to_string(j) + "]";
+                    if (to_str(leases[static_cast<size_t>(j)]) != expected) {
+                        ++failures;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(warm_allocations, size_t{THREADS * LEASES});
+    // no thread holds more blocks than its leases, the spare ones are always found
+    EXPECT_EQ(pool.allocations(), warm_allocations);
+}
+
+TEST(TestJsonBuffer, PmrBuffer)
+{
+    std::array<char, 64 * 1024> arena{};
+    // throws std::bad_alloc on an allocation out of the arena
+    std::pmr::monotonic_buffer_resource resource{arena.data(), arena.size(),
+                                                 std::pmr::null_memory_resource()};
+    const auto in_arena = [&arena](const jsonwriter::Buffer& buffer) {
+        return buffer.data() >= arena.data() && buffer.end() <= arena.data() + arena.size();
+    };
+
+    jsonwriter::PmrBuffer out{&resource, 16};
+    EXPECT_TRUE(in_arena(out));
+    jsonwriter::write(out, std::vector<int>(1000, 7));
+    EXPECT_GT(out.capacity(), 16u);
+    EXPECT_TRUE(in_arena(out));
+
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, std::vector<int>(1000, 7));
+    EXPECT_EQ(to_str(out), to_str(expected));
+
+    const auto moved = std::move(out);
+    EXPECT_EQ(to_str(moved), to_str(expected));
+
+    jsonwriter::PmrBuffer overflow{&resource};
+    EXPECT_THROW(jsonwriter::write(overflow, std::vector<int>(100000, 7)), std::bad_alloc);
+}
+
+TEST(TestJsonBuffer, ContainerBuffer)
+{
+    const std::vector<int> document(1000, 7);
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    std::string str{"x="};
+    {
+        jsonwriter::StringBuffer out{str, 16};
+        jsonwriter::write(out, document);
+        EXPECT_EQ(out.data(), str.data());
+        EXPECT_EQ(&out.finish(), &str);
+        EXPECT_EQ(str, "x=" + to_str(expected));
+    }
+    EXPECT_EQ(str, "x=" + to_str(expected));
+
+    std::vector<char> vec{};
+    {
+        jsonwriter::VectorBuffer out{vec};
+        jsonwriter::write(out, document);
+        // trimmed by the destructor
+    }
+    EXPECT_EQ((std::string{vec.begin(), vec.end()}), to_str(expected));
+
+    std::vector<char, jsonwriter::DefaultInitAllocator<char>> uninitialized{'x'};
+    {
+        jsonwriter::DefaultInitVectorBuffer out{uninitialized};
+        jsonwriter::write(out, document);
+    }
+    EXPECT_EQ((std::string{uninitialized.begin(), uninitialized.end()}), "x" + to_str(expected));
+}
+
+TEST(TestJsonBuffer, FixedBuffer)
+{
+    jsonwriter::FixedBuffer<32> out{};
+    const auto data = out.data();
+    jsonwriter::write(out, std::array<int, 3>{{1, 2, 3}});
+    out.mark();
+    EXPECT_FALSE(out.overflowed());
+    EXPECT_EQ(out.view(), "[1,2,3]");
+    EXPECT_EQ(out.complete_view(), "[1,2,3]");
+
+    for (int i{0}; i < 100; ++i) {
+        jsonwriter::write(out, std::array<int, 3>{{i, i, i}});
+        out.mark();
+    }
+    EXPECT_TRUE(out.overflowed());
+    EXPECT_EQ(out.data(), data);
+    EXPECT_EQ(out.view(), "[1,2,3][0,0,0][1,1,1][2,2,2][3,3");
+    EXPECT_EQ(out.complete_view(), "[1,2,3][0,0,0][1,1,1][2,2,2]");
+
+    out.clear();
+    EXPECT_FALSE(out.overflowed());
+    jsonwriter::write(out, "abc");
+    EXPECT_EQ(out.view(), "\"abc\"");
+    // the end of the scratch space
+    jsonwriter::write(out, std::string(2000, 'x'));
+    EXPECT_TRUE(out.overflowed());
+    EXPECT_EQ(out.view(), "\"abc\"\"" + std::string(26, 'x'));
+
+    // cleared through the base class too
+    jsonwriter::Buffer& erased = out;
+    erased.clear();
+    EXPECT_FALSE(out.overflowed());
+    EXPECT_EQ(out.complete_view(), "");
+
+    // large values are discarded in pieces
+    jsonwriter::FixedBuffer<16> small{};
+    jsonwriter::write(small, std::array<int, 1000>{});
+    jsonwriter::write(small, std::vector<int>(10000, 1));
+    jsonwriter::write(small, std::string(10000, 'x'));
+    EXPECT_TRUE(small.overflowed());
+    EXPECT_EQ(small.view(), "[0,0,0,0,0,0,0,0");
+}
+
+#ifndef _WIN32
+
+/// Temporary file, its content can be read back.
+class TempFile
+{
+public:
+    TempFile()
+        : m_file{std::tmpfile()}
+    {
+    }
+    ~TempFile() { std::fclose(m_file); }
+
+    int fd() const { return fileno(m_file); }
+
+    std::string read() const
+    {
+        std::string content(static_cast<size_t>(::lseek(fd(), 0, SEEK_END)), '\0');
+        EXPECT_EQ(::pread(fd(), content.data(), content.size(), 0),
+                  static_cast<ssize_t>(content.size()));
+        return content;
+    }
+
+private:
+    std::FILE* m_file;
+};
+
+TEST(TestJsonBuffer, FdBuffer)
+{
+    std::vector<std::string> document{};
+    for (int i{0}; i < 1000; ++i) {
+        document.push_back(std::to_string(i) + std::string(static_cast<size_t>(i % 70), '\n'));
+    }
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    TempFile file{};
+    {
+        jsonwriter::FdBuffer out{file.fd(), 64};
+        jsonwriter::write(out, document);
+        // grows only for the largest single reservation
+        EXPECT_LE(out.capacity(), 1024u);
+        EXPECT_GT(out.flushed(), 0u);
+        out.flush();
+        EXPECT_EQ(out.size(), 0u);
+        EXPECT_EQ(out.flushed(), expected.size());
+    }
+    EXPECT_EQ(file.read(), to_str(expected));
+
+    {
+        // flushed by the destructor
+        TempFile other_file{};
+        {
+            jsonwriter::FdBuffer out{other_file.fd()};
+            jsonwriter::write(out, document);
+        }
+        EXPECT_EQ(other_file.read(), to_str(expected));
+    }
+
+    {
+        jsonwriter::FdBuffer out{-1, 16};
+        EXPECT_THROW(jsonwriter::write(out, document), std::system_error);
+    }
+}
+
+TEST(TestJsonBuffer, ThreadedFdBuffer)
+{
+    std::vector<std::string> document{};
+    for (int i{0}; i < 1000; ++i) {
+        document.push_back(std::to_string(i) + std::string(static_cast<size_t>(i % 70), '\n'));
+    }
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    TempFile file{};
+    {
+        // the chunks grow for the largest single reservation
+        jsonwriter::ThreadedFdBuffer out{file.fd(), 64, 3};
+        jsonwriter::write(out, document);
+        EXPECT_LE(out.capacity(), 1024u);
+        EXPECT_GT(out.flushed(), 0u);
+        out.flush();
+        EXPECT_EQ(out.size(), 0u);
+        EXPECT_EQ(out.flushed(), expected.size());
+        // continues in order after a flush
+        jsonwriter::write(out, document);
+        out.flush();
+    }
+    EXPECT_EQ(file.read(), to_str(expected) + to_str(expected));
+
+    {
+        // flushed by the destructor
+        TempFile other_file{};
+        {
+            jsonwriter::ThreadedFdBuffer out{other_file.fd(), 4096};
+            jsonwriter::write(out, document);
+        }
+        EXPECT_EQ(other_file.read(), to_str(expected));
+    }
+
+    {
+        jsonwriter::ThreadedFdBuffer out{-1, 16};
+        EXPECT_THROW(
+            {
+                jsonwriter::write(out, document);
+                out.flush();
+            },
+            std::system_error);
+        // the rest is dropped
+        jsonwriter::write(out, "x");
+        EXPECT_THROW(out.flush(), std::system_error);
+    }
+}
+
+/// Reads the socket until the peer closes it.
+std::string read_all(const int fd)
+{
+    std::string content{};
+    std::array<char, 4096> chunk{};
+    for (ssize_t n; (n = ::read(fd, chunk.data(), chunk.size())) > 0;) {
+        content.append(chunk.data(), static_cast<size_t>(n));
+    }
+    return content;
+}
+
+/// Sends the document through a SocketBuffer from the first socket and reads it from the
+/// second one.
+std::string send_document(const std::vector<std::string>& document, const int fds[2],
+                          const size_t chunk_size, const bool zerocopy, size_t* zerocopy_chunks)
+{
+    std::string received{};
+    std::thread reader{[&received, fds] { received = read_all(fds[1]); }};
+    {
+        jsonwriter::SocketBuffer out{fds[0], chunk_size, zerocopy};
+        jsonwriter::write(out, document);
+        // the response is never materialized
+        EXPECT_LE(out.capacity(), std::max<size_t>(chunk_size, 1024));
+        out.flush();
+        *zerocopy_chunks = out.zerocopy_chunks();
+    }
+    ::shutdown(fds[0], SHUT_WR);
+    reader.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return received;
+}
+
+TEST(TestJsonBuffer, SocketBuffer)
+{
+    std::vector<std::string> document{};
+    for (int i{0}; i < 10000; ++i) {
+        document.push_back(std::to_string(i) + std::string(static_cast<size_t>(i % 70), '\n'));
+    }
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    size_t zerocopy_chunks{0};
+    {
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        EXPECT_EQ(send_document(document, fds, 64, false, &zerocopy_chunks), to_str(expected));
+        EXPECT_EQ(zerocopy_chunks, 0u);
+    }
+
+    {
+        // a closed peer throws instead of raising SIGPIPE
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        ::close(fds[1]);
+        {
+            jsonwriter::SocketBuffer out{fds[0], 16};
+            EXPECT_THROW(
+                {
+                    jsonwriter::write(out, document);
+                    out.flush();
+                },
+                std::system_error);
+        }
+        ::close(fds[0]);
+    }
+
+    // zerocopy over the loopback, the kernel copies anyway but reports the completions
+    const int listener{::socket(AF_INET, SOCK_STREAM, 0)};
+    ASSERT_GE(listener, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length{sizeof(address)};
+    ASSERT_EQ(::bind(listener, reinterpret_cast<sockaddr*>(&address), length), 0);
+    ASSERT_EQ(::listen(listener, 1), 0);
+    ASSERT_EQ(::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length), 0);
+    int fds[2];
+    fds[0] = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(::connect(fds[0], reinterpret_cast<sockaddr*>(&address), length), 0);
+    fds[1] = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+    ASSERT_GE(fds[1], 0);
+    {
+        jsonwriter::SocketBuffer probe{fds[0], 16, true};
+        if (!probe.zerocopy()) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+            GTEST_SKIP() << "no zerocopy";
+        }
+    }
+    EXPECT_EQ(send_document(document, fds, 32 * 1024, true, &zerocopy_chunks), to_str(expected));
+    EXPECT_GT(zerocopy_chunks, 0u);
+}
+
+/// Temporary file path, the file is removed at the end.
+class TempPath
+{
+public:
+    TempPath()
+    {
+        const int fd{::mkstemp(m_path.data())};
+        EXPECT_GE(fd, 0);
+        ::close(fd);
+    }
+    ~TempPath() { ::unlink(m_path.c_str()); }
+
+    const char* c_str() const { return m_path.c_str(); }
+
+    std::string read() const
+    {
+        std::string content{};
+        std::FILE* const file{std::fopen(c_str(), "rb")};
+        std::array<char, 4096> chunk{};
+        for (size_t n; (n = std::fread(chunk.data(), 1, chunk.size(), file)) > 0;) {
+            content.append(chunk.data(), n);
+        }
+        std::fclose(file);
+        return content;
+    }
+
+private:
+    std::string m_path{"/tmp/jsonwriter_test_XXXXXX"};
+};
+
+#ifdef __linux__
+TEST(TestJsonBuffer, UringFileBuffer)
+{
+    std::vector<std::string> document{};
+    for (int i{0}; i < 1000; ++i) {
+        document.push_back(std::to_string(i) + std::string(static_cast<size_t>(i % 70), '\n'));
+    }
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    TempFile file{};
+    try {
+        jsonwriter::UringFileBuffer probe{file.fd()};
+    } catch (const std::system_error& error) {
+        GTEST_SKIP() << error.what();
+    }
+
+    {
+        // the chunks grow for the largest single reservation
+        jsonwriter::UringFileBuffer out{file.fd(), 64, 3};
+        jsonwriter::write(out, document);
+        EXPECT_LE(out.capacity(), 1024u);
+        EXPECT_GT(out.flushed(), 0u);
+        out.flush();
+        EXPECT_EQ(out.size(), 0u);
+        EXPECT_EQ(out.flushed(), expected.size());
+    }
+    EXPECT_EQ(file.read(), to_str(expected));
+
+    {
+        // flushed by the destructor, from the file position
+        TempFile other_file{};
+        ASSERT_EQ(::write(other_file.fd(), "x", 1), 1);
+        {
+            jsonwriter::UringFileBuffer out{other_file.fd(), 4096};
+            jsonwriter::write(out, document);
+        }
+        EXPECT_EQ(other_file.read(), "x" + to_str(expected));
+    }
+
+    {
+        TempPath path{};
+        const int read_only{::open(path.c_str(), O_RDONLY)};
+        jsonwriter::UringFileBuffer out{read_only, 16};
+        EXPECT_THROW(
+            {
+                jsonwriter::write(out, document);
+                out.flush();
+            },
+            std::system_error);
+        ::close(read_only);
+    }
+}
+#endif
+
+TEST(TestJsonBuffer, MappedFileBuffer)
+{
+    std::vector<int> document(100000);
+    std::iota(document.begin(), document.end(), -5000);
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    TempPath path{};
+    {
+        jsonwriter::MappedFileBuffer out{path.c_str(), 100};
+        jsonwriter::write(out, document);
+        EXPECT_EQ(to_str(out), to_str(expected));
+        out.close();
+    }
+    EXPECT_EQ(path.read(), to_str(expected));
+
+    {
+        // closed by the destructor
+        jsonwriter::MappedFileBuffer out{path.c_str()};
+        jsonwriter::write(out, "abc");
+    }
+    EXPECT_EQ(path.read(), "\"abc\"");
+
+    {
+        // the file starts at the prepended data
+        jsonwriter::MappedFileBuffer out{path.c_str(), 100};
+        out.reserve_headroom(16);
+        jsonwriter::write(out, document);
+        out.prepend("1:");
+    }
+    EXPECT_EQ(path.read(), "1:" + to_str(expected));
+
+    EXPECT_THROW(jsonwriter::MappedFileBuffer{"/nonexistent/dir/file"}, std::system_error);
+}
+
+TEST(TestJsonBuffer, MmapBuffer)
+{
+    // larger than a huge page
+    std::vector<int> document(500000);
+    std::iota(document.begin(), document.end(), -5000);
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    for (const bool huge_pages : {false, true}) {
+        jsonwriter::MmapBuffer out{100, huge_pages};
+        const auto initial_capacity = out.capacity();
+        EXPECT_GE(initial_capacity, 100u);
+        jsonwriter::write(out, document);
+        EXPECT_GT(out.capacity(), initial_capacity);
+        EXPECT_EQ(to_str(out), to_str(expected));
+    }
+}
+
+static std::string to_str(const std::vector<iovec>& vectors)
+{
+    std::string result{};
+    for (const auto& vector : vectors) {
+        result.append(static_cast<const char*>(vector.iov_base), vector.iov_len);
+    }
+    return result;
+}
+
+TEST(TestJsonBuffer, ChainBuffer)
+{
+    std::vector<std::string> document{};
+    for (int i{0}; i < 1000; ++i) {
+        document.push_back(std::to_string(i) + std::string(static_cast<size_t>(i % 70), '\n'));
+    }
+    jsonwriter::SimpleBuffer expected{};
+    jsonwriter::write(expected, document);
+
+    jsonwriter::ChainBuffer out{64};
+    for (int round{0}; round < 2; ++round) {
+        jsonwriter::write(out, document);
+        EXPECT_EQ(out.total_size(), expected.size());
+        const auto vectors = out.iovecs();
+        EXPECT_GT(vectors.size(), 100u);
+        EXPECT_EQ(to_str(vectors), to_str(expected));
+
+        TempFile file{};
+        out.write_to(file.fd());
+        EXPECT_EQ(file.read(), to_str(expected));
+
+        out.clear();
+        EXPECT_EQ(out.total_size(), 0u);
+        EXPECT_TRUE(out.iovecs().empty());
+    }
+
+    jsonwriter::write(out, document);
+    out.linearize();
+    EXPECT_EQ(out.iovecs().size(), 1u);
+    EXPECT_EQ(to_str(out), to_str(expected));
+    jsonwriter::write(out, 5);
+    EXPECT_EQ(to_str(out.iovecs()), to_str(expected) + "5");
+
+    // the following segments keep the configured size
+    EXPECT_LT(out.capacity(), 1024u);
+    out.clear();
+    jsonwriter::write(out, document);
+    EXPECT_LT(out.capacity(), 1024u);
+    EXPECT_EQ(to_str(out.iovecs()), to_str(expected));
+}
+
+TEST(TestJsonBuffer, ChainBufferSplice)
+{
+    auto blob = std::make_shared<std::string>("[" + std::string(1000, '1') + "]");
+    const std::string small_blob{"{\"a\":1}"};
+    const auto write_document = [&](auto& out) {
+        jsonwriter::write(out, jsonwriter::Object{[&](auto& object) {
+                              object["blob"] = jsonwriter::ExternalJson{*blob, blob};
+                              object["small"] = jsonwriter::ExternalJson{small_blob};
+                              object["n"] = 5;
+                          }});
+    };
+    const std::string expected{"{\"blob\":" + *blob + ",\"small\":" + small_blob + ",\"n\":5}"};
+
+    jsonwriter::SimpleBuffer copied{};
+    write_document(copied);
+    EXPECT_EQ(to_str(copied), expected);
+
+    jsonwriter::ChainBuffer out{64};
+    write_document(out);
+    EXPECT_EQ(out.total_size(), expected.size());
+    const auto vectors = out.iovecs();
+    EXPECT_EQ(to_str(vectors), expected);
+    // referenced, not copied
+    EXPECT_EQ(std::count_if(vectors.begin(), vectors.end(),
+                            [&](const iovec& vector) { return vector.iov_base == blob->data(); }),
+              1);
+    EXPECT_EQ(blob.use_count(), 2);
+
+    out.splice("[]", 2);
+    EXPECT_EQ(to_str(out.iovecs()), expected + "[]");
+
+    // copied in pieces by the other buffers, larger than their scratch spaces
+    const std::string large_blob(10000, '1');
+    jsonwriter::FixedBuffer<16> fixed{};
+    jsonwriter::write(fixed, jsonwriter::ExternalJson{large_blob});
+    EXPECT_TRUE(fixed.overflowed());
+    EXPECT_EQ(fixed.view(), large_blob.substr(0, 16));
+    EXPECT_EQ(jsonwriter::serialized_size(jsonwriter::ExternalJson{large_blob}), large_blob.size());
+
+    out.linearize();
+    EXPECT_EQ(blob.use_count(), 1);
+    EXPECT_EQ(to_str(out), expected + "[]");
+
+    write_document(out);
+    out.clear();
+    EXPECT_EQ(blob.use_count(), 1);
+
+    // the headroom is dropped by splicing
+    out.clear();
+    out.reserve_headroom(4);
+    jsonwriter::write(out, "abc");
+    out.splice("EXT", 3);
+    EXPECT_EQ(out.headroom(), 0u);
+    jsonwriter::write(out, "d");
+    EXPECT_EQ(to_str(out.iovecs()), "\"abc\"EXT\"d\"");
+    out.linearize();
+    EXPECT_EQ(to_str(out), "\"abc\"EXT\"d\"");
+
+    // cleared through the base class too
+    write_document(out);
+    jsonwriter::Buffer& erased = out;
+    erased.clear();
+    EXPECT_EQ(blob.use_count(), 1);
+    EXPECT_TRUE(out.iovecs().empty());
+    jsonwriter::write(out, 5);
+    out.linearize();
+    EXPECT_EQ(to_str(out), "5");
+}
+
+TEST(TestJsonBuffer, RollbackPassedOn)
+{
+    {
+        // across segment switches, the sealed data is still in memory
+        jsonwriter::ChainBuffer out{16};
+        jsonwriter::write(out, jsonwriter::List{[&out](jsonwriter::ListProxy& list) {
+                              list.push_back(1);
+                              const auto mark = out.checkpoint();
+                              list.push_back("xx");
+                              out.rollback(mark);
+                              list.push_back(2);
+                          }});
+        EXPECT_EQ(to_str(out.iovecs()), "[1,2]");
+
+        out.clear();
+        jsonwriter::write(out, "0123456789");
+        auto mark = out.checkpoint();
+        for (int i{0}; i < 3; ++i) {
+            jsonwriter::write(out, "abcdefgh");
+        }
+        EXPECT_GT(out.iovecs().size(), 1u);
+        out.rollback(mark);
+        EXPECT_EQ(out.total_size(), 12u);
+        std::string expected{"\"0123456789\"1"};
+        jsonwriter::write(out, 1);
+        for (int i{0}; i < 3; ++i) {
+            jsonwriter::write(out, "abcdefgh");
+            expected += "\"abcdefgh\"";
+        }
+        EXPECT_EQ(to_str(out.iovecs()), expected);
+
+        // the spliced data after the mark is dropped
+        const auto blob = std::make_shared<std::string>(1000, '1');
+        mark = out.checkpoint();
+        jsonwriter::write(out, jsonwriter::ExternalJson{*blob, blob});
+        jsonwriter::write(out, 2);
+        out.splice("EXT", 3);
+        out.rollback(mark);
+        jsonwriter::write(out, 3);
+        expected += "3";
+        EXPECT_EQ(to_str(out.iovecs()), expected);
+        // and the one before kept
+        out.splice("EXT", 3);
+        mark = out.checkpoint();
+        jsonwriter::write(out, std::string(100, 'x'));
+        out.rollback(mark);
+        jsonwriter::write(out, 4);
+        expected += "EXT4";
+        EXPECT_EQ(to_str(out.iovecs()), expected);
+        out.linearize();
+        EXPECT_EQ(to_str(out), expected);
+    }
+    {
+        TempFile file{};
+        jsonwriter::FdBuffer out{file.fd(), 64};
+        jsonwriter::write(out, "abc");
+        auto mark = out.checkpoint();
+        jsonwriter::write(out, std::string(100, 'x'));
+        EXPECT_GT(out.flushed(), 0u);
+        EXPECT_THROW(out.rollback(mark), jsonwriter::RollbackError);
+        mark = out.checkpoint();
+        jsonwriter::write(out, 1);
+        out.rollback(mark);
+        out.flush();
+        EXPECT_EQ(file.read(), "\"abc\"\"" + std::string(100, 'x') + "\"");
+    }
+    {
+        // the data up to the capacity is still there
+        jsonwriter::FixedBuffer<16> out{};
+        jsonwriter::write(out, "abc");
+        const auto mark = out.checkpoint();
+        jsonwriter::write(out, std::string(40, 'x'));
+        EXPECT_TRUE(out.overflowed());
+        out.rollback(mark);
+        EXPECT_FALSE(out.overflowed());
+        jsonwriter::write(out, 1);
+        EXPECT_EQ(out.view(), "\"abc\"1");
+
+        // the discarded data is dropped anyway
+        jsonwriter::write(out, std::string(40, 'x'));
+        const auto overflowed_mark = out.checkpoint();
+        jsonwriter::write(out, std::string(100, 'y'));
+        out.rollback(overflowed_mark);
+        EXPECT_TRUE(out.overflowed());
+        EXPECT_EQ(out.view(), "\"abc\"1\"" + std::string(9, 'x'));
+    }
+    {
+        // the data moved to the storage before switching to the scratch space
+        char storage[64];
+        jsonwriter::ExactBuffer out{storage, sizeof(storage)};
+        jsonwriter::write(out, "abc");
+        const auto mark = out.checkpoint();
+        while (out.data() == storage) {
+            jsonwriter::write(out, 1);
+        }
+        out.rollback(mark);
+        jsonwriter::write(out, 2);
+        EXPECT_EQ(out.finish(), 6u);
+        EXPECT_EQ((std::string_view{storage, 6}), "\"abc\"2");
+    }
+}
+
+#endif
+
 //==========================================================================
 
 TEST(TestJsonWriter, Char)
@@ -226,6 +1430,220 @@ TEST(TestJsonWriter, Floats)
     }
 }
 
+TEST(TestJsonWriter, FloatsNonFinite)
+{
+    constexpr auto nan = std::numeric_limits<double>::quiet_NaN();
+    constexpr auto inf = std::numeric_limits<double>::infinity();
+
+    const auto f = [](auto formatter, const auto value) {
+        jsonwriter::SimpleBuffer out{};
+        decltype(formatter)::write(out, value);
+        return to_str(out);
+    };
+
+    using jsonwriter::NonFinite;
+    EXPECT_EQ(f(jsonwriter::Formatter<double>{}, nan), "NaN");
+    EXPECT_EQ(f(jsonwriter::Formatter<double>{}, -inf), "-Infinity");
+    EXPECT_EQ(f(jsonwriter::FormatterFloat<double, NonFinite::null>{}, nan), "null");
+    EXPECT_EQ(f(jsonwriter::FormatterFloat<double, NonFinite::null>{}, inf), "null");
+    EXPECT_EQ(f(jsonwriter::FormatterFloat<double, NonFinite::null>{}, -1.5), "-1.5E0");
+    EXPECT_EQ(f(jsonwriter::FormatterFloat<float, NonFinite::string>{},
+                std::numeric_limits<float>::quiet_NaN()),
+              "\"NaN\"");
+    EXPECT_EQ(f(jsonwriter::FormatterFloat<double, NonFinite::string>{}, -inf), "\"-Infinity\"");
+    EXPECT_EQ(f(jsonwriter::FormatterFloat<double, NonFinite::string>{}, 0.0), "0E0");
+    EXPECT_THROW(f(jsonwriter::FormatterFloat<double, NonFinite::error>{}, inf),
+                 jsonwriter::NonFiniteError);
+    EXPECT_EQ(f(jsonwriter::FormatterFloat<double, NonFinite::error>{}, 2.5), "2.5E0");
+
+    EXPECT_EQ(f(jsonwriter::FormatterFloat16<jsonwriter::Float16, NonFinite::null>{},
+                jsonwriter::Float16{0x7e00}),
+              "null");
+    EXPECT_EQ(f(jsonwriter::FormatterFloat16<jsonwriter::BFloat16, NonFinite::string>{},
+                jsonwriter::BFloat16{0xff80}),
+              "\"-Infinity\"");
+    EXPECT_THROW(f(jsonwriter::FormatterFloat16List<jsonwriter::Float16, NonFinite::error>{},
+                   std::vector<jsonwriter::Float16>{{0x3c00}, {0x7c00}}),
+                 jsonwriter::NonFiniteError);
+}
+
+std::string odr_write_nan(); // odr.cpp, built with JSONWRITER_NON_FINITE null
+
+TEST(TestJsonWriter, FloatsNonFiniteOtherUnit)
+{
+    jsonwriter::SimpleBuffer out{};
+    jsonwriter::write(out, std::numeric_limits<double>::quiet_NaN());
+    EXPECT_EQ(to_str(out), "NaN");
+    EXPECT_EQ(odr_write_nan(), "null");
+}
+
+/// Reference conversion with round-to-nearest-even of a parsed value to a 16-bit float format.
+static uint16_t round_to_16bit(const double value, const int significand_bits,
+                               const int exponent_bits)
+{
+    uint64_t u{};
+    ::memcpy(&u, &value, sizeof(u));
+    const uint32_t sign{static_cast<uint32_t>(u >> 63) << 15};
+    u &= ~(uint64_t{1} << 63);
+
+    const int bias{(1 << (exponent_bits - 1)) - 1};
+    int double_exponent{static_cast<int>(u >> 52)};
+    uint64_t m{u & ((uint64_t{1} << 52) - 1)};
+    if (double_exponent == 0) {
+        if (m == 0) {
+            return static_cast<uint16_t>(sign);
+        }
+        double_exponent = 1;
+    } else {
+        m |= uint64_t{1} << 52;
+    }
+    // value = m * 2^e
+    const int e{double_exponent - 1075};
+    int top{e};
+    for (uint64_t t{m}; t > 1; t >>= 1) {
+        ++top;
+    }
+    const int target_exponent{std::max(top, 1 - bias) - significand_bits};
+    const int shift{target_exponent - e};
+    if (shift >= 64) {
+        return static_cast<uint16_t>(sign);
+    }
+    uint64_t q{m >> shift};
+    const uint64_t rem{m & ((uint64_t{1} << shift) - 1)};
+    const uint64_t half{uint64_t{1} << (shift - 1)};
+    if (rem > half || (rem == half && (q & 1) != 0)) {
+        ++q;
+    }
+    uint32_t bits{static_cast<uint32_t>(q)};
+    if (top >= 1 - bias) {
+        bits = (static_cast<uint32_t>(top + bias) << significand_bits)
+               + static_cast<uint32_t>(q - (uint64_t{1} << significand_bits));
+    }
+    const uint32_t infinity{((1u << exponent_bits) - 1) << significand_bits};
+    return static_cast<uint16_t>(sign | std::min(bits, infinity));
+}
+
+template<typename T>
+static void check_float16_exhaustive(const int significand_bits, const int exponent_bits)
+{
+    const uint32_t exponent_mask{((1u << exponent_bits) - 1) << significand_bits};
+
+    for (uint32_t i{0}; i <= 0xffff; ++i) {
+        const T value{static_cast<uint16_t>(i)};
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, value);
+        const auto str = to_str(out);
+        ASSERT_LE(out.size(), jsonwriter::FormatterFloat16<T>::MAX_LEN);
+
+        if ((i & exponent_mask) == exponent_mask) {
+            if ((i & ~(0x8000 | exponent_mask)) != 0) {
+                EXPECT_EQ(str, "NaN");
+            } else {
+                EXPECT_EQ(str, (i & 0x8000) != 0 ? "-Infinity" : "Infinity");
+            }
+            continue;
+        }
+
+        // round-trip
+        const double parsed{::strtod(str.c_str(), nullptr)};
+        ASSERT_EQ(round_to_16bit(parsed, significand_bits, exponent_bits), i) << str;
+
+        // no representation with less digits rounds to the same value
+        const auto mantissa = str.substr(0, str.find('E'));
+        const auto digits = static_cast<int>(std::count_if(
+            mantissa.begin(), mantissa.end(), [](const char c) { return c >= '0' && c <= '9'; }));
+        for (int shorter{1}; shorter < digits; ++shorter) {
+            char candidate[64];
+            ::snprintf(candidate, sizeof(candidate), "%.*e", shorter - 1, parsed);
+            const double nearest{::strtod(candidate, nullptr)};
+            const double unit{
+                std::pow(10.0, std::floor(std::log10(std::abs(nearest))) - shorter + 1)};
+            for (const double c : {nearest - unit, nearest, nearest + unit}) {
+                ::snprintf(candidate, sizeof(candidate), "%.*e", shorter - 1, c);
+                ASSERT_NE(round_to_16bit(::strtod(candidate, nullptr), significand_bits,
+                                         exponent_bits),
+                          i)
+                    << str << " vs. " << candidate;
+            }
+        }
+    }
+}
+
+TEST(TestJsonWriter, Float16)
+{
+    const auto f = [](const auto value) {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, value);
+        return to_str(out);
+    };
+
+    EXPECT_EQ(f(jsonwriter::Float16{0x0000}), "0E0");
+    EXPECT_EQ(f(jsonwriter::Float16{0x8000}), "-0E0");
+    EXPECT_EQ(f(jsonwriter::Float16{0x3c00}), "1E0");
+    EXPECT_EQ(f(jsonwriter::Float16{0x2e66}), "1E-1");
+    EXPECT_EQ(f(jsonwriter::Float16{0x4248}), "3.14E0");
+    EXPECT_EQ(f(jsonwriter::Float16{0xc248}), "-3.14E0");
+    EXPECT_EQ(f(jsonwriter::Float16{0x7bff}), "6.55E4");
+    EXPECT_EQ(f(jsonwriter::Float16{0x0001}), "6E-8");
+    EXPECT_EQ(f(jsonwriter::Float16{0x7c00}), "Infinity");
+    EXPECT_EQ(f(jsonwriter::Float16{0xfc00}), "-Infinity");
+    EXPECT_EQ(f(jsonwriter::Float16{0x7e00}), "NaN");
+
+    EXPECT_EQ(f(jsonwriter::BFloat16{0x0000}), "0E0");
+    EXPECT_EQ(f(jsonwriter::BFloat16{0x3f80}), "1E0");
+    EXPECT_EQ(f(jsonwriter::BFloat16{0x4049}), "3.14E0");
+    EXPECT_EQ(f(jsonwriter::BFloat16{0x3dcd}), "1E-1");
+    EXPECT_EQ(f(jsonwriter::BFloat16{0x7f7f}), "3.39E38");
+    EXPECT_EQ(f(jsonwriter::BFloat16{0x0001}), "1E-40");
+    EXPECT_EQ(f(jsonwriter::BFloat16{0xff80}), "-Infinity");
+}
+
+TEST(TestJsonWriter, Float16Exhaustive)
+{
+    check_float16_exhaustive<jsonwriter::Float16>(10, 5);
+    check_float16_exhaustive<jsonwriter::BFloat16>(7, 8);
+}
+
+TEST(TestJsonWriter, Float16List)
+{
+    std::vector<jsonwriter::Float16> values{};
+    std::string expected{"["};
+    for (uint16_t i{0}; i < 200; ++i) {
+        values.push_back(jsonwriter::Float16{static_cast<uint16_t>(0x3c00 + i)});
+        jsonwriter::SimpleBuffer item{};
+        jsonwriter::write(item, values.back());
+        expected += (i == 0 ? "" : ",") + to_str(item);
+    }
+    expected += "]";
+
+    {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, values);
+        EXPECT_EQ(to_str(out), expected);
+    }
+    {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, jsonwriter::Span{values.data(), values.size()});
+        EXPECT_EQ(to_str(out), expected);
+    }
+    {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, std::vector<jsonwriter::BFloat16>{});
+        EXPECT_EQ(to_str(out), "[]");
+    }
+    {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, std::array<jsonwriter::BFloat16, 2>{{{0x3f80}, {0xbf80}}});
+        EXPECT_EQ(to_str(out), "[1E0,-1E0]");
+    }
+    {
+        jsonwriter::SimpleBuffer out{};
+        const int ints[] = {1, 2, 3};
+        jsonwriter::write(out, jsonwriter::Span{ints, 3});
+        EXPECT_EQ(to_str(out), "[1,2,3]");
+    }
+}
+
 TEST(TestJsonWriter, Bool)
 {
     {
@@ -443,6 +1861,55 @@ struct jsonwriter::Formatter<SomeEnum>
     }
 };
 
+TEST(TestJsonWriter, Rollback)
+{
+    {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, jsonwriter::Object{[&out](auto& object) {
+                              // the first member dropped
+                              auto mark = out.checkpoint();
+                              object["dropped"] = jsonwriter::Object{[](auto& nested_object) {
+                                  nested_object["a"] = 1;
+                              }};
+                              out.rollback(mark);
+                              object["k1"] = 1;
+                              mark = out.checkpoint();
+                              bool rejected{false};
+                              object["k2"] = jsonwriter::Object{[&rejected](auto& nested_object) {
+                                  nested_object["a"] = 1;
+                                  rejected = true;
+                              }};
+                              if (rejected) {
+                                  out.rollback(mark);
+                              }
+                              // accepted without copying
+                              mark = out.checkpoint();
+                              object["k3"] = jsonwriter::List{[&out](auto& list) {
+                                  list.push_back(1);
+                                  const auto item_mark = out.checkpoint();
+                                  list.push_back("x");
+                                  out.rollback(item_mark);
+                                  list.push_back(2);
+                              }};
+                          }});
+        EXPECT_EQ(to_str(out), "{\"k1\":1,\"k3\":[1,2]}");
+    }
+    {
+        // type-erased proxy, the first item dropped
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, jsonwriter::List{[&out](jsonwriter::ListProxy& list) {
+                              const auto mark = out.checkpoint();
+                              list.push_back(1);
+                              out.rollback(mark);
+                              list.push_back(2);
+                          }});
+        jsonwriter::Buffer::Checkpoint mark = out.checkpoint();
+        jsonwriter::write(out, 3);
+        out.rollback(mark);
+        EXPECT_EQ(to_str(out), "[2]");
+    }
+}
+
 TEST(TestJsonWriter, CustomEnumLabel)
 {
     jsonwriter::SimpleBuffer out{};
@@ -511,3 +1978,107 @@ TEST(TestJsonWriter, CustomStructWithBuiltInFormatter_Const)
     jsonwriter::write(out, s);
     EXPECT_EQ(to_str(out), "{\"b\":666}");
 }
+
+TEST(TestJsonWriter, Cursor)
+{
+    jsonwriter::SimpleBuffer<16> out{};
+    out.context = std::string{"hello"};
+    out.append('[');
+    {
+        auto cursor = out.reserve_cursor(20);
+        EXPECT_GE(cursor.room(), 20u);
+        jsonwriter::write(cursor, 123);
+        cursor.append(',');
+        // committed at the scope end
+        EXPECT_EQ(out.size(), 1u);
+    }
+    EXPECT_EQ(to_str(out), "[123,");
+    {
+        auto cursor = out.reserve_cursor(200);
+        jsonwriter::write(cursor, jsonwriter::Object{[](auto& object) {
+                              object["a"] = {1, 2};
+                              object["b"] = "q\"";
+                              object["c"] = 2.5;
+                              object["d"] = std::optional<bool>{true};
+                              object["e"] = jsonwriter::List([](auto& list) {
+                                  list.push_back(jsonwriter::Float16{0x3c00});
+                                  list.push_back(jsonwriter::empty_object);
+                              });
+                              // Buffer& formatters run on the underlying buffer
+                              object["f"] = SomeEnum::BLUE;
+                              object["g"] = SomeStruct{};
+                          }});
+        cursor.append(']');
+    }
+    EXPECT_EQ(to_str(out), "[123,{\"a\":[1,2],\"b\":\"q\\\"\",\"c\":2.5E0,\"d\":true,"
+                           "\"e\":[1E0,{}],\"f\":blue,\"g\":{\"a\":42,\"ctx\":\"hello\"}}]");
+}
+
+struct BoundedPoint
+{
+    int x;
+    double y;
+    std::array<bool, 2> flags;
+    std::optional<jsonwriter::Float16> weight;
+};
+
+template<>
+struct jsonwriter::Formatter<BoundedPoint>
+{
+    static constexpr size_t MAX_SIZE{
+        max_object_size<int, double, std::array<bool, 2>, std::optional<Float16>, char[4]>(
+            {{"x", "y", "flags", "weight", "tag"}})};
+
+    template<typename BufferType>
+    static void write(BufferType& buffer, const BoundedPoint& value)
+    {
+        jsonwriter::write(buffer, jsonwriter::Object{[&value](auto& object) {
+                              object["x"] = value.x;
+                              object["y"] = value.y;
+                              object["flags"] = value.flags;
+                              object["weight"] = value.weight;
+                              object["tag"] = "\n\t\"";
+                          }});
+    }
+};
+
+TEST(TestJsonWriter, MaxSerializedSize)
+{
+    static_assert(jsonwriter::max_serialized_size_v<int8_t> == 4);
+    static_assert(jsonwriter::max_serialized_size_v<uint64_t> == 20);
+    static_assert(jsonwriter::max_serialized_size_v<bool> == 5);
+    static_assert(jsonwriter::max_serialized_size_v<std::optional<bool>> == 5);
+    static_assert(jsonwriter::max_serialized_size_v<std::array<int16_t, 3>> == 2 + 3 * 7);
+    static_assert(jsonwriter::max_serialized_size_v<BoundedPoint> > 0);
+    static_assert(!jsonwriter::detail::HasMaxSerializedSize<std::string>::value);
+    static_assert(!jsonwriter::detail::HasMaxSerializedSize<std::vector<int>>::value);
+    static_assert(!jsonwriter::detail::HasMaxSerializedSize<SomeStruct>::value);
+
+    const auto check_bound = [](const auto& value) {
+        jsonwriter::SimpleBuffer out{};
+        jsonwriter::write(out, value);
+        using T = std::remove_cv_t<std::remove_reference_t<decltype(value)>>;
+        EXPECT_LE(out.size(), jsonwriter::max_serialized_size_v<T>);
+    };
+    check_bound(std::numeric_limits<int64_t>::min());
+    check_bound(std::numeric_limits<uint64_t>::max());
+    check_bound(std::numeric_limits<int8_t>::min());
+    check_bound(-std::numeric_limits<double>::denorm_min());
+    check_bound(-std::numeric_limits<float>::max());
+    check_bound(jsonwriter::BFloat16{0x8001});
+    check_bound(std::array<jsonwriter::Float16, 3>{});
+    check_bound(std::array<jsonwriter::Float16, 0>{});
+    check_bound('\x01');
+
+    // a single capacity check for the whole object
+    VectorBackedBuffer out{};
+    jsonwriter::write(out, BoundedPoint{-7, 0.5, {{true, false}}, jsonwriter::Float16{0x3c00}});
+    EXPECT_EQ(to_str(out),
+              "{\"x\":-7,\"y\":5E-1,\"flags\":[true,false],\"weight\":1E0,\"tag\":\"\\n\\t\\\"\"}");
+    EXPECT_EQ(out.reallocs, 1u);
+    out.clear();
+    jsonwriter::write(out, std::array<BoundedPoint, 2>{});
+    EXPECT_EQ(to_str(out), "[{\"x\":0,\"y\":0E0,\"flags\":[false,false],\"weight\":null,\"tag\":"
+                           "\"\\n\\t\\\"\"},{\"x\":0,\"y\":0E0,\"flags\":[false,false],"
+                           "\"weight\":null,\"tag\":\"\\n\\t\\\"\"}]");
+}
@@ -0,0 +1,89 @@
+// Buffer::stats(), a separate program since JSONWRITER_INSTRUMENTATION changes the Buffer layout.
+
+#define JSONWRITER_INSTRUMENTATION 1
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "jsonwriter/writer.hpp"
+
+#ifndef _WIN32
+#include "jsonwriter/chain.hpp"
+#include "jsonwriter/mmap.hpp"
+#endif
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+//==========================================================================
+
+TEST(TestJsonBufferStats, Growth)
+{
+    jsonwriter::SimpleBuffer<16> out{};
+    EXPECT_EQ(out.stats().peak_capacity, 16u);
+
+    jsonwriter::write(out, std::vector<int>(1000, 7));
+    const auto stats = out.stats();
+    // 2001 bytes, 16 * 1.5^n
+    EXPECT_EQ(stats.reallocs, 12u);
+    EXPECT_GT(stats.bytes_copied, 2001u);
+    EXPECT_LT(stats.bytes_copied, 2 * 2001u);
+    EXPECT_EQ(stats.peak_capacity, out.capacity());
+    EXPECT_GE(stats.reservations, 1000u);
+    EXPECT_GT(stats.reservation_waste, 0u);
+
+    out.reset_stats();
+    EXPECT_EQ(out.stats().reallocs, 0u);
+    EXPECT_EQ(out.stats().peak_capacity, out.capacity());
+}
+
+TEST(TestJsonBufferStats, ReservationWaste)
+{
+    jsonwriter::SimpleBuffer out{};
+    out.make_room(10);
+    out.consume(4);
+    out.make_room(2);
+    out.consume(2);
+    auto stats = out.stats();
+    EXPECT_EQ(stats.reservations, 2u);
+    EXPECT_EQ(stats.reservation_waste, 6u);
+    EXPECT_EQ(stats.reallocs, 0u);
+    EXPECT_EQ(stats.bytes_copied, 0u);
+
+    // through the type-erased buffer
+    jsonwriter::Buffer& erased{out};
+    erased.make_room(2000);
+    erased.consume(1);
+    stats = out.stats();
+    EXPECT_EQ(stats.reservations, 3u);
+    EXPECT_EQ(stats.reservation_waste, 6u + 1999u);
+    EXPECT_EQ(stats.reallocs, 1u);
+    EXPECT_EQ(stats.bytes_copied, 6u);
+}
+
+TEST(TestJsonBufferStats, Copies)
+{
+    std::string copied{};
+    jsonwriter::StringBuffer container{copied, 16};
+    jsonwriter::write(container, std::vector<int>(1000, 7));
+    EXPECT_GT(container.stats().reallocs, 0u);
+    EXPECT_GT(container.stats().bytes_copied, 2001u);
+
+#ifndef _WIN32
+    // growth without copying the data
+    jsonwriter::ChainBuffer chain{16};
+    jsonwriter::write(chain, std::vector<int>(1000, 7));
+    EXPECT_GT(chain.stats().reallocs, 0u);
+    EXPECT_EQ(chain.stats().bytes_copied, 0u);
+
+    jsonwriter::MmapBuffer mapped{1};
+    jsonwriter::write(mapped, std::vector<std::string>(10000, "abc"));
+    EXPECT_GT(mapped.stats().reallocs, 0u);
+    EXPECT_EQ(mapped.stats().bytes_copied, 0u);
+#endif
+}